@@ -1,10 +1,87 @@
 #version 330 core
 
+// Compiled with PROCEDURAL defined for './game2 --render procedural' (see procedural.h)
+#ifdef PROCEDURAL
+
+// Position and box type of every instance, one RGBA32F texel each
+uniform samplerBuffer Instances;
+uniform mat4 VP;
+
+// Palette: size and face colours of each box type (BoxType in procedural.h)
+const int MAX_BOX_TYPES = 4;
+uniform vec3 BoxSize[MAX_BOX_TYPES];
+uniform vec3 FaceColor[6 * MAX_BOX_TYPES];
+
+// Corner of each of the 36 vertices, bit 0/1/2 set means +x/+y/+z - must match mesh.h
+const int CUBE_INDICES[36] = int[36](
+    0, 1, 3,  3, 2, 0,
+    3, 2, 6,  6, 7, 3,
+    7, 3, 1,  1, 5, 7,
+    0, 1, 5,  5, 4, 0,
+    7, 5, 4,  4, 6, 7,
+    0, 2, 6,  6, 4, 0
+);
+
+out vec3 fragColor;
+
+void main ()
+{
+    vec4 instance = texelFetch(Instances, gl_InstanceID);
+    int type = int(instance.w);
+    int corner = CUBE_INDICES[gl_VertexID];
+    vec3 position = (vec3(corner & 1, (corner >> 1) & 1, (corner >> 2) & 1) - 0.5) * BoxSize[type];
+
+    fragColor = FaceColor[6 * type + gl_VertexID / 6];
+
+    // Translation only, like the mesh path: VP with the last column replaced
+    mat4 MVP = VP;
+    MVP[3] = VP * vec4(instance.xyz, 1);
+    gl_Position = MVP * vec4(position, 1);
+}
+
+#elif defined(POINTS)
+
+// Compiled with POINTS defined for './game2 --render points': one point per
+// tile, passed on to Tiles.geom which turns it into boxes
+layout (location = 0) in vec4 tilePoint; // xyz position, w tile type
+
+out vec4 tile;
+
+void main ()
+{
+    tile = tilePoint;
+}
+
+#else
+
 // input data : sent from main program
 layout (location = 0) in vec3 vertexPosition;
-layout (location = 1) in vec3 vertexColor;
+layout (location = 1) in uint vertexFace; // which colour of the object's palette
 
-uniform mat4 MVP;
+// View-projection of the frame and the object being drawn
+uniform mat4 VP;
+uniform int Object;
+
+// Last MVP column (VP * position) of every object, written by the CPU into
+// a per-frame region of a dynamic buffer. One array per row, four objects
+// per vec4 - must match MAX_SCENE_OBJECTS in game2.cpp
+const int MAX_OBJECTS = 256;
+layout (std140) uniform Objects
+{
+    vec4 ColumnX[MAX_OBJECTS / 4];
+    vec4 ColumnY[MAX_OBJECTS / 4];
+    vec4 ColumnZ[MAX_OBJECTS / 4];
+    vec4 ColumnW[MAX_OBJECTS / 4];
+    ivec4 PaletteOf[MAX_OBJECTS / 4];
+};
+
+// Six face colours per palette, one palette per box type - must match
+// MAX_PALETTES in game2.cpp
+const int MAX_PALETTES = 4;
+layout (std140) uniform Palette
+{
+    vec4 FaceColors[6 * MAX_PALETTES];
+};
 
 // output data : used by fragment shader
 out vec3 fragColor;
@@ -13,10 +90,18 @@ void main ()
 {
     vec4 v = vec4(vertexPosition, 1); // Transform an homogeneous 4D vector
 
+    // Every object is only translated: its MVP is VP with the last column replaced
+    int slot = Object / 4;
+    int lane = Object % 4;
+    mat4 MVP = VP;
+    MVP[3] = vec4(ColumnX[slot][lane], ColumnY[slot][lane], ColumnZ[slot][lane], ColumnW[slot][lane]);
+
     // The color of each vertex will be interpolated
     // to produce the color of each fragment
-    fragColor = vertexColor;
+    fragColor = FaceColors[6 * PaletteOf[slot][lane] + int(vertexFace)].rgb;
 
     // Output position of the vertex, in clip space : MVP * position
     gl_Position = MVP * v;
 }
+
+#endif
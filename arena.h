@@ -0,0 +1,160 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+/*
+ * GPU memory arena for the meshes: a few large vertex buffers ("pages")
+ * that hand out vertex ranges, instead of two VBOs and a VAO per object.
+ *
+ * Vertices are interleaved (position, face number for the colour palette,
+ * 16 bytes in all) and every page has one VAO
+ * set up once when the page is created, so all meshes on a page share it
+ * and are drawn with glDrawArrays from their first vertex - consecutive
+ * draws need no VAO or VBO rebinds.
+ *
+ * Each page keeps a free list of vertex ranges sorted by offset. Allocation
+ * is first fit, which on a fresh page is a bump of the first free range;
+ * released ranges are merged with their free neighbours. A mesh that does
+ * not fit in any page gets a new page (at least PAGE_VERTICES large).
+ *
+ * GL objects are not registered here, the caller does that per page.
+ */
+
+#include <algorithm>
+#include <vector>
+
+/* Where a mesh lives in the arena */
+struct ArenaRange {
+	int Page;
+	GLint First;	// first vertex, for glDrawArrays
+	GLsizei Count;
+};
+
+/* One vertex as stored in a page */
+struct ArenaVertex {
+	GLfloat X, Y, Z;
+	GLubyte Face;	// palette entry within the object's palette
+	GLubyte Padding[3];
+};
+
+class MeshArena {
+public:
+	static const GLsizei PAGE_VERTICES = 16384;	// 256 KiB
+
+	MeshArena () : used(0) {}
+
+	/* Copy 'count' vertices (3 floats of position and a face number each) into a free range */
+	ArenaRange allocate (const GLfloat* positions, const GLubyte* faces, GLsizei count)
+	{
+		ArenaRange range = { -1, 0, count };
+		for (size_t p = 0; p < pages.size() && range.Page < 0; p++) {
+			if (take(pages[p], count, range.First))
+				range.Page = p;
+		}
+		if (range.Page < 0) {
+			addPage(std::max(count, (GLsizei) PAGE_VERTICES));
+			range.Page = pages.size() - 1;
+			take(pages.back(), count, range.First);
+		}
+
+		std::vector<ArenaVertex> vertices(count);
+		for (GLsizei i = 0; i < count; i++) {
+			ArenaVertex vertex = { positions[3*i], positions[3*i + 1], positions[3*i + 2], faces[i], { 0, 0, 0 } };
+			vertices[i] = vertex;
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, pages[range.Page].Buffer);
+		glBufferSubData(GL_ARRAY_BUFFER, range.First * sizeof(ArenaVertex), count * sizeof(ArenaVertex), &vertices[0]);
+		used += count;
+		return range;
+	}
+
+	/* Give a range back - the GPU may still be drawing from it, only reuse it for new uploads */
+	void release (const ArenaRange& range)
+	{
+		std::vector<Free>& free = pages[range.Page].FreeList;
+		Free freed = { range.First, range.Count };
+		std::vector<Free>::iterator next = free.begin();
+		while (next != free.end() && next->First < freed.First)
+			++next;
+
+		// Merge with the free range after and the one before, if they touch
+		if (next != free.end() && freed.First + freed.Count == next->First) {
+			freed.Count += next->Count;
+			next = free.erase(next);
+		}
+		if (next != free.begin() && (next - 1)->First + (next - 1)->Count == freed.First)
+			(next - 1)->Count += freed.Count;
+		else
+			free.insert(next, freed);
+		used -= range.Count;
+	}
+
+	/* Delete every page - all ranges become invalid */
+	void destroy ()
+	{
+		for (size_t p = 0; p < pages.size(); p++) {
+			glDeleteVertexArrays(1, &pages[p].VertexArray);
+			glDeleteBuffers(1, &pages[p].Buffer);
+		}
+		pages.clear();
+		used = 0;
+	}
+
+	int pageCount () const { return pages.size(); }
+	GLuint vertexArray (int page) const { return pages[page].VertexArray; }
+	GLuint buffer (int page) const { return pages[page].Buffer; }
+	size_t pageBytes (int page) const { return pages[page].Capacity * sizeof(ArenaVertex); }
+	size_t usedVertices () const { return used; }
+
+private:
+	struct Free {
+		GLint First;
+		GLsizei Count;
+	};
+
+	struct Page {
+		GLuint VertexArray;
+		GLuint Buffer;
+		GLsizei Capacity;	// vertices
+		std::vector<Free> FreeList;	// sorted by First, never touching
+	};
+
+	/* First fit: cut 'count' vertices off the front of the first free range that holds them */
+	static bool take (Page& page, GLsizei count, GLint& first)
+	{
+		for (std::vector<Free>::iterator it = page.FreeList.begin(); it != page.FreeList.end(); ++it) {
+			if (it->Count < count)
+				continue;
+			first = it->First;
+			it->First += count;
+			it->Count -= count;
+			if (it->Count == 0)
+				page.FreeList.erase(it);
+			return true;
+		}
+		return false;
+	}
+
+	void addPage (GLsizei capacity)
+	{
+		Page page;
+		page.Capacity = capacity;
+		Free all = { 0, capacity };
+		page.FreeList.push_back(all);
+
+		glGenVertexArrays(1, &page.VertexArray);
+		glGenBuffers(1, &page.Buffer);
+		glBindVertexArray(page.VertexArray);
+		glBindBuffer(GL_ARRAY_BUFFER, page.Buffer);
+		glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(ArenaVertex), NULL, GL_STATIC_DRAW);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(ArenaVertex), (void*) 0);	// position
+		glVertexAttribIPointer(1, 1, GL_UNSIGNED_BYTE, sizeof(ArenaVertex), (void*) (3 * sizeof(GLfloat)));	// face
+		glEnableVertexAttribArray(0);
+		glEnableVertexAttribArray(1);
+		pages.push_back(page);
+	}
+
+	std::vector<Page> pages;
+	size_t used;	// vertices handed out
+};
+
+#endif
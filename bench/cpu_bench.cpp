@@ -0,0 +1,204 @@
+/*
+    CPU microbenchmarks for the game's hot paths, no display or GL context
+    needed: the per-object MVP computation of draw() (full product, the
+    translation-only path and the batch kernel, also on 1M tiles) and move
+    resolution from keyboard(). The meshes themselves are generated at
+    compile time (mesh.h).
+
+    Each benchmark is calibrated to run for about 10 ms per repetition and
+    repeated (15 times by default); ns/op is reported as min, median, mean
+    and standard deviation over the repetitions, as JSON on stdout.
+
+    Build and run with 'make bench', or './bench/cpu_bench [repetitions]'.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <glad/glad.h>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtx/transform.hpp>
+
+#include "../mesh.h"
+#include "../moves.h"
+#include "../transform.h"
+
+using namespace std;
+
+// Results are folded in here so the optimiser cannot drop the work
+volatile float sink;
+
+glm::mat4 sceneVP ()
+{
+	glm::mat4 projection = glm::ortho(-8.0f, 8.0f, -8.0f, 8.0f, 0.1f, 500.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(-1, 6, 1), glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+	return projection * view;
+}
+
+/* Positions of what draw() renders: tiles except pits, obstacles, the person */
+TranslationBatch scenePositions ()
+{
+	TranslationBatch positions;
+	int index = 0;
+	for (float i = 4.5; i >= -4.5; i--) {
+		for (float j = 4.5; j >= -4.5; j--) {
+			if (index % 8 != 5) {
+				positions.add(i, 0, j);
+				if (index % 6 == 1)
+					positions.add(i, 1, j);
+			}
+			index++;
+		}
+	}
+	positions.add(-4.5, 1, -4.5);
+	return positions;
+}
+
+/* One frame of MVPs, each a full VP * translate() product */
+struct FrameFullProduct {
+	glm::mat4 VP;
+	TranslationBatch positions;
+
+	FrameFullProduct () : VP(sceneVP()), positions(scenePositions()) {}
+
+	void operator() ()
+	{
+		float sum = 0;
+		for (size_t i = 0; i < positions.size(); i++)
+			sum += modelMVP(VP, glm::translate(glm::vec3(positions.X[i], positions.Y[i], positions.Z[i])))[3][0];
+		sink = sum;
+	}
+};
+
+/* The same with the translation-only specialisation, one object at a time */
+struct FrameTranslated {
+	glm::mat4 VP;
+	TranslationBatch positions;
+
+	FrameTranslated () : VP(sceneVP()), positions(scenePositions()) {}
+
+	void operator() ()
+	{
+		float sum = 0;
+		for (size_t i = 0; i < positions.size(); i++)
+			sum += translatedMVP(VP, positions.X[i], positions.Y[i], positions.Z[i])[3][0];
+		sink = sum;
+	}
+};
+
+/* The batch kernel draw() uses, over 'tiles' positions */
+struct BatchColumns {
+	glm::mat4 VP;
+	TranslationBatch positions;
+	MVPColumns columns;
+
+	explicit BatchColumns (size_t tiles) : VP(sceneVP())
+	{
+		if (tiles == 0) {
+			positions = scenePositions();
+			return;
+		}
+		for (size_t i = 0; i < tiles; i++)
+			positions.add(i % 1000, 0, i / 1000);
+	}
+
+	void operator() ()
+	{
+		computeTranslatedColumns(VP, positions, columns);
+		sink = columns.W[positions.size() - 1];
+	}
+};
+
+/* A walk over the board that hits free tiles, obstacles, pits and jumps */
+struct ResolveMoves {
+	PersonState person;
+	int step;
+
+	ResolveMoves () : step(0) { reset(); }
+
+	void reset ()
+	{
+		PersonState start = { -4.5, 1, -4.5, 99, 3, false };
+		person = start;
+	}
+
+	void operator() ()
+	{
+		static const MoveDirection walk[] = { MOVE_RIGHT, MOVE_UP, MOVE_RIGHT, MOVE_RIGHT, MOVE_UP, MOVE_LEFT, MOVE_DOWN, MOVE_UP, MOVE_RIGHT, MOVE_UP };
+		const int walk_length = sizeof(walk) / sizeof(walk[0]);
+		if (step % 7 == 3)
+			person.Jump = true;
+		if (resolveMove(person, walk[step++ % walk_length]) == MOVE_FELL) {
+			person.PosY = 1;
+			person.PosX = person.PosZ = -4.5;
+		}
+		if (person.Lives == 0 || person.BlockPos == 0)
+			reset();
+		sink = person.PosX;
+	}
+};
+
+double nowNs ()
+{
+	return chrono::duration<double, nano>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+template <typename Op>
+double timeOps (Op& op, long long iterations)
+{
+	double start = nowNs();
+	for (long long i = 0; i < iterations; i++)
+		op();
+	return (nowNs() - start) / iterations;
+}
+
+template <typename Op>
+void run (const char* name, const char* unit, Op op, int repetitions, bool last)
+{
+	// Grow the iteration count until one repetition takes about 10 ms
+	long long iterations = 1;
+	while (timeOps(op, iterations) * iterations < 1e7 && iterations < (1LL << 40))
+		iterations *= 2;
+
+	vector<double> samples;
+	for (int r = 0; r < repetitions; r++)
+		samples.push_back(timeOps(op, iterations));
+	sort(samples.begin(), samples.end());
+
+	double mean = 0, variance = 0;
+	for (size_t i = 0; i < samples.size(); i++)
+		mean += samples[i] / samples.size();
+	for (size_t i = 0; i < samples.size(); i++)
+		variance += (samples[i] - mean) * (samples[i] - mean) / samples.size();
+
+	printf("    {\"name\": \"%s\", \"op\": \"%s\", \"iterations\": %lld, \"min_ns\": %.2f, \"median_ns\": %.2f, "
+			"\"mean_ns\": %.2f, \"stddev_ns\": %.2f}%s\n",
+			name, unit, iterations, samples.front(), samples[samples.size() / 2], mean, sqrt(variance), last ? "" : ",");
+}
+
+int main (int argc, char** argv)
+{
+	int repetitions = argc > 1 ? atoi(argv[1]) : 15;
+	if (repetitions < 1)
+		repetitions = 1;
+
+	// Per frame: one MVP for every object of the scene
+	char frame_unit[64];
+	snprintf(frame_unit, sizeof(frame_unit), "frame (%d MVPs)", (int) scenePositions().size());
+
+	printf("{\n  \"benchmark\": \"cpu\",\n  \"repetitions\": %d,\n  \"results\": [\n", repetitions);
+	run("frame_full_product", frame_unit, FrameFullProduct(), repetitions, false);
+	run("frame_translated", frame_unit, FrameTranslated(), repetitions, false);
+	run("frame_batch", frame_unit, BatchColumns(0), repetitions, false);
+	run("batch_1m_tiles", "1M MVP columns", BatchColumns(1000000), repetitions, false);
+	run("resolve_move", "move", ResolveMoves(), repetitions, true);
+	printf("  ]\n}\n");
+	return 0;
+}
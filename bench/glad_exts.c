@@ -0,0 +1,152 @@
+/*
+    Microbenchmark for glad's extension detection (find_extensionsGL).
+
+    glad.c is included directly so the static get_exts/has_ext helpers run
+    unchanged against a fake context that reports a recorded Mesa llvmpipe
+    extension list. The hashed lookup is compared with the linear scan that
+    glad used before (strcmp over glGetStringi, strstr over GL_EXTENSIONS).
+
+    Build and run with 'make bench-glad'.
+*/
+
+#define _POSIX_C_SOURCE 199309L
+#include <time.h>
+#include "../glad.c"
+
+static const char *mesa_exts[] = {
+#include "mesa_llvmpipe_exts.inc"
+};
+#define NUM_MESA_EXTS ((int)(sizeof(mesa_exts) / sizeof(mesa_exts[0])))
+
+/* every name queried by find_extensionsGL, extracted from glad.c */
+static const char *known_exts[] = {
+#include "glad_known_exts.inc"
+};
+#define NUM_KNOWN_EXTS ((int)(sizeof(known_exts) / sizeof(known_exts[0])))
+
+static char mesa_exts_string[16384];
+
+static const GLubyte * APIENTRY fake_glGetString(GLenum name) {
+    switch(name) {
+        case GL_VERSION: return (const GLubyte *)"4.5 (Core Profile) Mesa";
+        case GL_EXTENSIONS: return (const GLubyte *)mesa_exts_string;
+        default: return NULL;
+    }
+}
+
+static const GLubyte * APIENTRY fake_glGetStringi(GLenum name, GLuint index) {
+    if(name != GL_EXTENSIONS || index >= (GLuint)NUM_MESA_EXTS) return NULL;
+    return (const GLubyte *)mesa_exts[index];
+}
+
+static void APIENTRY fake_glGetIntegerv(GLenum pname, GLint *data) {
+    if(pname == GL_NUM_EXTENSIONS) *data = NUM_MESA_EXTS;
+}
+
+/* glad's original lookups, kept here as the baseline */
+static int linear_has_ext_i(const char *ext) {
+    int index;
+    for(index = 0; index < num_exts_i; index++) {
+        if(strcmp(exts_i[index], ext) == 0) return 1;
+    }
+    return 0;
+}
+
+static int linear_has_ext_string(const char *ext) {
+    const char *extensions = exts;
+    const char *loc;
+    const char *terminator;
+
+    while(1) {
+        loc = strstr(extensions, ext);
+        if(loc == NULL) return 0;
+
+        terminator = loc + strlen(ext);
+        if((loc == extensions || *(loc - 1) == ' ') &&
+            (*terminator == ' ' || *terminator == '\0')) {
+            return 1;
+        }
+        extensions = terminator;
+    }
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int found;
+
+static void pass_hashed(void) {
+    int index;
+    get_exts();
+    for(index = 0; index < NUM_KNOWN_EXTS; index++) found += has_ext(known_exts[index]);
+    free_exts();
+}
+
+static void pass_linear(void) {
+    int index;
+    if(max_loaded_major < 3) {
+        exts = (const char *)glGetString(GL_EXTENSIONS);
+        for(index = 0; index < NUM_KNOWN_EXTS; index++) found += linear_has_ext_string(known_exts[index]);
+    } else {
+        num_exts_i = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &num_exts_i);
+        exts_i = (const char **)realloc((void *)exts_i, num_exts_i * sizeof *exts_i);
+        for(index = 0; index < num_exts_i; index++) {
+            exts_i[index] = (const char *)glGetStringi(GL_EXTENSIONS, index);
+        }
+        for(index = 0; index < NUM_KNOWN_EXTS; index++) found += linear_has_ext_i(known_exts[index]);
+        free_exts();
+    }
+}
+
+static double time_pass(void (*pass)(void), int iterations) {
+    double start;
+    int index;
+
+    pass();
+    start = now_ns();
+    for(index = 0; index < iterations; index++) pass();
+    return (now_ns() - start) / iterations;
+}
+
+static void run(const char *mode, int major, int iterations, int last) {
+    double hashed, linear;
+    int hits;
+
+    max_loaded_major = major;
+    found = 0;
+    pass_hashed();
+    hits = found;
+
+    hashed = time_pass(pass_hashed, iterations);
+    linear = time_pass(pass_linear, iterations);
+
+    printf("    {\"mode\": \"%s\", \"reported\": %d, \"queried\": %d, \"found\": %d, "
+           "\"linear_ns\": %.0f, \"hashed_ns\": %.0f, \"speedup\": %.1f}%s\n",
+           mode, NUM_MESA_EXTS, NUM_KNOWN_EXTS, hits, linear, hashed, linear / hashed, last ? "" : ",");
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 2000;
+    int index;
+
+    mesa_exts_string[0] = '\0';
+    for(index = 0; index < NUM_MESA_EXTS; index++) {
+        strcat(mesa_exts_string, mesa_exts[index]);
+        strcat(mesa_exts_string, " ");
+    }
+
+    glGetString = fake_glGetString;
+    glGetStringi = fake_glGetStringi;
+    glGetIntegerv = fake_glGetIntegerv;
+
+    printf("{\n  \"benchmark\": \"glad_find_extensions\",\n  \"iterations\": %d,\n  \"results\": [\n", iterations);
+    run("glGetStringi", 3, iterations, 0);
+    run("GL_EXTENSIONS", 2, iterations, 1);
+    printf("  ]\n}\n");
+
+    return 0;
+}
@@ -0,0 +1,141 @@
+#ifndef BOARDMESH_H
+#define BOARDMESH_H
+
+/*
+ * The board as one static mesh, with the faces nobody can see left out.
+ *
+ * Neighbouring tiles touch, so the side faces between two solid tiles are
+ * always covered. Only the sides next to a pit or on the edge of the board
+ * are kept, and no bottoms: the camera never goes below the board. The
+ * tops of all tiles are coplanar, so they are covered greedily with as few
+ * rectangles as possible: grow each rectangle along z while the tiles are
+ * solid, then along x while the whole row is. Kept sides facing the same
+ * way in a row of tiles are merged into one quad the same way. A board
+ * without pits comes down to ten triangles, where the cubes took twelve
+ * per tile.
+ *
+ * Every quad is triangulated like the cube face it stands for (CUBE_INDICES
+ * in mesh.h) and carries that face's number, so the board palette colours
+ * it exactly like the per-tile cubes. No GL calls, include after glad.
+ */
+
+#include <vector>
+
+#include "mesh.h"
+
+/* SizeX x SizeZ tiles of one unit, tile (x, z) spanning [MinX + x, MinX + x + 1] */
+struct TileGrid {
+	int SizeX, SizeZ;
+	GLfloat MinX, MinZ;
+	GLfloat MinY, MaxY;	// bottom and top of every tile
+	std::vector<bool> Solid;	// [x * SizeZ + z], false for pits
+
+	bool solid (int x, int z) const
+	{
+		return x >= 0 && x < SizeX && z >= 0 && z < SizeZ && Solid[x * SizeZ + z];
+	}
+};
+
+/* Tiles [X, X + SizeX) x [Z, Z + SizeZ), all solid */
+struct TileRect {
+	int X, Z;
+	int SizeX, SizeZ;
+};
+
+struct BoardMeshData {
+	std::vector<GLfloat> Vertices;
+	std::vector<GLubyte> Faces;
+	int Rects;	// top rectangles after merging
+	int SideQuads;	// after merging too
+
+	int numVertices () const { return Faces.size(); }
+};
+
+/* Append one face of the box [x0, x1] x [y0, y1] x [z0, z1], split like the cube's */
+inline void addBoxFace (BoardMeshData& mesh, int face, GLfloat x0, GLfloat x1, GLfloat y0, GLfloat y1, GLfloat z0, GLfloat z1)
+{
+	for (int k = 0; k < 6; k++) {
+		int corner = CUBE_INDICES[6*face + k];
+		mesh.Vertices.push_back(corner & 1 ? x1 : x0);
+		mesh.Vertices.push_back(corner & 2 ? y1 : y0);
+		mesh.Vertices.push_back(corner & 4 ? z1 : z0);
+		mesh.Faces.push_back(face);
+	}
+}
+
+/* Cover the solid tiles with rectangles, greedily from tile (0, 0) */
+inline std::vector<TileRect> mergeTiles (const TileGrid& grid)
+{
+	std::vector<TileRect> rects;
+	std::vector<bool> covered(grid.SizeX * grid.SizeZ, false);
+	for (int x = 0; x < grid.SizeX; x++) {
+		for (int z = 0; z < grid.SizeZ; z++) {
+			if (!grid.solid(x, z) || covered[x * grid.SizeZ + z])
+				continue;
+			TileRect rect = { x, z, 1, 1 };
+			while (grid.solid(x, z + rect.SizeZ) && !covered[x * grid.SizeZ + z + rect.SizeZ])
+				rect.SizeZ++;
+			for (bool grow = true; grow; ) {
+				int next = x + rect.SizeX;
+				for (int k = 0; k < rect.SizeZ && grow; k++)
+					grow = grid.solid(next, z + k) && !covered[next * grid.SizeZ + z + k];
+				if (grow)
+					rect.SizeX++;
+			}
+			for (int i = 0; i < rect.SizeX; i++)
+				for (int k = 0; k < rect.SizeZ; k++)
+					covered[(x + i) * grid.SizeZ + z + k] = true;
+			rects.push_back(rect);
+		}
+	}
+	return rects;
+}
+
+inline void buildBoardMesh (const TileGrid& grid, BoardMeshData& mesh)
+{
+	const int TOP = 1;
+	mesh.Vertices.clear();
+	mesh.Faces.clear();
+	mesh.SideQuads = 0;
+
+	std::vector<TileRect> rects = mergeTiles(grid);
+	mesh.Rects = rects.size();
+	for (size_t i = 0; i < rects.size(); i++) {
+		GLfloat x0 = grid.MinX + rects[i].X, x1 = x0 + rects[i].SizeX;
+		GLfloat z0 = grid.MinZ + rects[i].Z, z1 = z0 + rects[i].SizeZ;
+		addBoxFace(mesh, TOP, x0, x1, grid.MinY, grid.MaxY, z0, z1);
+	}
+
+	// Sides only where the neighbour is a pit or off the board, merged
+	// along the row they lie in
+	for (int face = 0; face < 6; face++) {
+		int axis = CUBE_FACE_AXIS[face];
+		if (axis == 1)
+			continue;	// top and bottom
+		int step = CUBE_FACE_POSITIVE[face] ? 1 : -1;
+		int rows = axis == 0 ? grid.SizeX : grid.SizeZ;
+		int length = axis == 0 ? grid.SizeZ : grid.SizeX;
+		for (int row = 0; row < rows; row++) {
+			int start = -1;
+			for (int i = 0; i <= length; i++) {
+				int x = axis == 0 ? row : i, z = axis == 0 ? i : row;
+				bool exposed = i < length && grid.solid(x, z)
+					&& !grid.solid(x + (axis == 0 ? step : 0), z + (axis == 2 ? step : 0));
+				if (exposed && start < 0)
+					start = i;
+				if (exposed || start < 0)
+					continue;
+				GLfloat r0 = (axis == 0 ? grid.MinX : grid.MinZ) + row;
+				GLfloat i0 = (axis == 0 ? grid.MinZ : grid.MinX) + start, i1 = i0 + (i - start);
+				if (axis == 0)
+					addBoxFace(mesh, face, r0, r0 + 1, grid.MinY, grid.MaxY, i0, i1);
+				else
+					addBoxFace(mesh, face, i0, i1, grid.MinY, grid.MaxY, r0, r0 + 1);
+				mesh.SideQuads++;
+				start = -1;
+			}
+		}
+	}
+}
+
+#endif
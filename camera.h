@@ -0,0 +1,107 @@
+#ifndef CAMERA_H
+#define CAMERA_H
+
+/*
+ * Camera with cached view, projection and view-projection matrices.
+ *
+ * The matrices are only rebuilt when something they depend on changed:
+ * the eye position (A/S keys) or the zoom (Z/O keys, animated). Reading
+ * viewProjection() on a frame where nothing changed is a plain copy. revision() counts the rebuilds, so
+ * anything rendered with the matrices can tell when it is out of date.
+ *
+ * The projection is an orthographic box of +-zoom around the origin. Zoom
+ * changes are animated in log space over ZOOM_DURATION seconds so each
+ * step feels the same at any zoom level; presses during an animation
+ * stack onto its target.
+ */
+
+#include <cmath>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+class Camera {
+public:
+	static constexpr float DEFAULT_ZOOM = 8.0f;
+	static constexpr double ZOOM_DURATION = 0.2;	// seconds
+
+	Camera () : eye(-1, 6, 1), zoom(DEFAULT_ZOOM), zoom_from(DEFAULT_ZOOM), zoom_to(DEFAULT_ZOOM),
+		zoom_start(0), animating(false), view_dirty(true), projection_dirty(true), revisions(0) {}
+
+	void setEye (const glm::vec3& position)
+	{
+		if (position == eye)
+			return;
+		eye = position;
+		view_dirty = true;
+	}
+
+	/* Start an animated zoom to 'factor' times the current target */
+	void zoomBy (float factor, double now)
+	{
+		zoom_from = zoom;
+		zoom_to *= factor;
+		zoom_start = now;
+		animating = true;
+	}
+
+	/* Jump to a zoom without animating */
+	void setZoom (float value)
+	{
+		zoom = zoom_from = zoom_to = value;
+		animating = false;
+		projection_dirty = true;
+	}
+
+	float zoomTarget () const { return zoom_to; }
+	bool isAnimating () const { return animating; }
+	unsigned revision () const { return revisions; }
+
+	/* Advance the zoom animation, returns true if the matrices changed */
+	bool update (double now)
+	{
+		if (animating) {
+			double t = ZOOM_DURATION > 0 ? (now - zoom_start) / ZOOM_DURATION : 1;
+			if (t >= 1) {
+				zoom = zoom_to;
+				animating = false;
+			}
+			else {
+				double s = t * t * (3 - 2 * t);	// smoothstep
+				zoom = zoom_from * std::pow(zoom_to / zoom_from, (float) s);
+			}
+			projection_dirty = true;
+		}
+		return view_dirty || projection_dirty;
+	}
+
+	const glm::mat4& viewProjection ()
+	{
+		if (view_dirty)
+			view = glm::lookAt(eye, glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+		if (projection_dirty)
+			projection = glm::ortho(-zoom, zoom, -zoom, zoom, 0.1f, 500.0f);
+		if (view_dirty || projection_dirty) {
+			view_projection = projection * view;
+			revisions++;
+		}
+		view_dirty = projection_dirty = false;
+		return view_projection;
+	}
+
+private:
+	glm::vec3 eye;
+	float zoom;
+	float zoom_from;
+	float zoom_to;
+	double zoom_start;
+	bool animating;
+	bool view_dirty;
+	bool projection_dirty;
+	unsigned revisions;	// times the matrices were rebuilt
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::mat4 view_projection;
+};
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef DAMAGE_H
+#define DAMAGE_H
+
+/*
+ * Damage tracking for partial redraws: the screen rectangles that changed
+ * since the last frame, so only those are drawn again over the retained
+ * previous frame (scissored, and only with the objects that touch them).
+ *
+ * Changed objects are added as boxes, projected to conservative pixel
+ * rectangles (all eight corners, rounded outwards plus a pixel for the
+ * rasteriser's edge rules, clipped to the framebuffer). Rectangles that
+ * overlap or touch are merged; beyond MAX_RECTS the pair whose union adds
+ * the least area is merged, so the frame has a few scissored passes at
+ * most. No GL calls, include after glad.
+ */
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+/* Pixels [X0, X1) x [Y0, Y1), GL window coordinates (bottom row 0) */
+struct ScreenRect {
+	int X0, Y0;
+	int X1, Y1;
+
+	bool empty () const { return X0 >= X1 || Y0 >= Y1; }
+	long area () const { return empty() ? 0 : (long) (X1 - X0) * (Y1 - Y0); }
+};
+
+inline ScreenRect unite (const ScreenRect& a, const ScreenRect& b)
+{
+	ScreenRect rect = { std::min(a.X0, b.X0), std::min(a.Y0, b.Y0), std::max(a.X1, b.X1), std::max(a.Y1, b.Y1) };
+	return rect;
+}
+
+/* Overlapping or sharing an edge */
+inline bool touches (const ScreenRect& a, const ScreenRect& b)
+{
+	return a.X0 <= b.X1 && b.X0 <= a.X1 && a.Y0 <= b.Y1 && b.Y0 <= a.Y1;
+}
+
+/* Pixels the box centred on 'center' with half extents 'half' can cover - empty if it is off screen */
+inline ScreenRect projectBox (const glm::mat4& VP, const glm::vec3& center, const glm::vec3& half, int width, int height)
+{
+	float x0 = std::numeric_limits<float>::infinity(), y0 = x0;
+	float x1 = -x0, y1 = -x0;
+	for (int corner = 0; corner < 8; corner++) {
+		glm::vec3 offset((corner & 1) ? half.x : -half.x, (corner & 2) ? half.y : -half.y, (corner & 4) ? half.z : -half.z);
+		glm::vec4 clip = VP * glm::vec4(center + offset, 1.0f);
+		// The camera is orthographic, w stays 1
+		x0 = std::min(x0, clip.x / clip.w);
+		y0 = std::min(y0, clip.y / clip.w);
+		x1 = std::max(x1, clip.x / clip.w);
+		y1 = std::max(y1, clip.y / clip.w);
+	}
+	if (x1 < -1 || x0 > 1 || y1 < -1 || y0 > 1) {
+		ScreenRect off_screen = { 0, 0, 0, 0 };
+		return off_screen;
+	}
+	// Keep the conversion to pixels in range, then pad and clip
+	x0 = std::max(x0, -1.0f);
+	y0 = std::max(y0, -1.0f);
+	x1 = std::min(x1, 1.0f);
+	y1 = std::min(y1, 1.0f);
+	ScreenRect rect = {
+		std::max(0, (int) std::floor((x0 + 1) * 0.5f * width) - 1),
+		std::max(0, (int) std::floor((y0 + 1) * 0.5f * height) - 1),
+		std::min(width, (int) std::ceil((x1 + 1) * 0.5f * width) + 1),
+		std::min(height, (int) std::ceil((y1 + 1) * 0.5f * height) + 1),
+	};
+	return rect;
+}
+
+class DamageRegion {
+public:
+	static const size_t MAX_RECTS = 4;
+
+	void clear () { rects.clear(); }
+
+	void add (const ScreenRect& rect)
+	{
+		if (rect.empty())
+			return;
+		// Merge until the new rectangle touches nothing that is left
+		ScreenRect merged = rect;
+		for (size_t i = 0; i < rects.size(); ) {
+			if (touches(rects[i], merged)) {
+				merged = unite(rects[i], merged);
+				rects.erase(rects.begin() + i);
+				i = 0;
+			}
+			else
+				i++;
+		}
+		rects.push_back(merged);
+		while (rects.size() > MAX_RECTS)
+			mergeCheapestPair();
+	}
+
+	const std::vector<ScreenRect>& rectangles () const { return rects; }
+	bool empty () const { return rects.empty(); }
+
+	long area () const
+	{
+		long total = 0;
+		for (size_t i = 0; i < rects.size(); i++)
+			total += rects[i].area();
+		return total;
+	}
+
+private:
+	void mergeCheapestPair ()
+	{
+		size_t best_i = 0, best_j = 1;
+		long best_growth = -1;
+		for (size_t i = 0; i < rects.size(); i++) {
+			for (size_t j = i + 1; j < rects.size(); j++) {
+				long growth = unite(rects[i], rects[j]).area() - rects[i].area() - rects[j].area();
+				if (best_growth < 0 || growth < best_growth) {
+					best_growth = growth;
+					best_i = i;
+					best_j = j;
+				}
+			}
+		}
+		ScreenRect merged = unite(rects[best_i], rects[best_j]);
+		rects.erase(rects.begin() + best_j);
+		rects.erase(rects.begin() + best_i);
+		add(merged);
+	}
+
+	std::vector<ScreenRect> rects;	// never touching each other
+};
+
+#endif
@@ -0,0 +1,168 @@
+#ifndef DYNBUFFER_H
+#define DYNBUFFER_H
+
+/*
+ * Ring of per-frame regions in one GL buffer, for data that is rewritten
+ * every frame (the objects' MVP columns, see draw()).
+ *
+ * Each frame writes the next of REGIONS regions while the GPU may still be
+ * reading the previous ones. fence() after the frame's last draw marks when
+ * its region is free again, and begin() only has to wait on that fence when
+ * the CPU gets REGIONS frames ahead of the GPU.
+ *
+ * How a region is written depends on what the driver offers:
+ *   PERSISTENT  GL_ARB_buffer_storage: the buffer is mapped once, persistent
+ *               and coherent, and the CPU writes straight into it
+ *   MAP_RANGE   glMapBufferRange on the region every frame, unsynchronized
+ *               (the fences already keep the GPU off it) and invalidated,
+ *               so the driver neither waits nor copies the old contents
+ *   COPY        staged in memory and uploaded with glBufferSubData - for GL
+ *               call captures, which cannot see writes to mapped memory
+ *
+ * A map that fails drops the buffer to the next mode down (PERSISTENT to
+ * MAP_RANGE when created, MAP_RANGE to COPY in begin()), with one message.
+ */
+
+#include <cstdio>
+#include <vector>
+
+class DynamicBuffer {
+public:
+	enum Mode { PERSISTENT, MAP_RANGE, COPY };
+	static const int REGIONS = 3;
+
+	DynamicBuffer () : buffer(0), target(0), mode(COPY), region_bytes(0), region(0), mapped(NULL), waits(0)
+	{
+		for (int i = 0; i < REGIONS; i++)
+			fences[i] = NULL;
+	}
+
+	/* Persistent mapping when the driver has it */
+	static Mode bestMode ()
+	{
+		return GLAD_GL_ARB_buffer_storage ? PERSISTENT : MAP_RANGE;
+	}
+
+	static const char* modeName (Mode mode)
+	{
+		static const char* const names[] = { "persistent", "map range", "copy" };
+		return names[mode];
+	}
+
+	/* 'size' bytes per region, each region starting on a multiple of 'alignment' */
+	void create (GLenum buffer_target, size_t size, size_t alignment, Mode buffer_mode)
+	{
+		target = buffer_target;
+		mode = buffer_mode;
+		region_bytes = (size + alignment - 1) / alignment * alignment;
+		region = REGIONS - 1;
+
+		glGenBuffers(1, &buffer);
+		glBindBuffer(target, buffer);
+		if (mode == PERSISTENT) {
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(target, totalBytes(), NULL, flags);
+			mapped = (char*) glMapBufferRange(target, 0, totalBytes(), flags);
+			if (mapped == NULL) {
+				// Storage is immutable, start over with a plain buffer
+				fprintf(stderr, "dynamic buffer: persistent map failed, using map range\n");
+				glDeleteBuffers(1, &buffer);
+				create(buffer_target, size, alignment, MAP_RANGE);
+				return;
+			}
+		}
+		else {
+			glBufferData(target, totalBytes(), NULL, GL_STREAM_DRAW);
+			if (mode == COPY)
+				staging.resize(region_bytes);
+		}
+	}
+
+	void destroy ()
+	{
+		for (int i = 0; i < REGIONS; i++) {
+			if (fences[i] != NULL)
+				glDeleteSync(fences[i]);
+			fences[i] = NULL;
+		}
+		if (mapped != NULL) {
+			glBindBuffer(target, buffer);
+			glUnmapBuffer(target);
+			mapped = NULL;
+		}
+		if (buffer != 0)
+			glDeleteBuffers(1, &buffer);
+		buffer = 0;
+	}
+
+	/* Move to the next region and return where to write it */
+	void* begin ()
+	{
+		region = (region + 1) % REGIONS;
+		if (fences[region] != NULL) {
+			GLenum status = glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+			if (status == GL_TIMEOUT_EXPIRED) {
+				waits++;
+				while (status == GL_TIMEOUT_EXPIRED)
+					status = glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);	// 1 s
+			}
+			glDeleteSync(fences[region]);
+			fences[region] = NULL;
+		}
+
+		if (mode == PERSISTENT)
+			return mapped + offset();
+		if (mode == MAP_RANGE) {
+			glBindBuffer(target, buffer);
+			void* region_data = glMapBufferRange(target, offset(), region_bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+			if (region_data != NULL)
+				return region_data;
+			// Stage and copy from now on - end() and fence() follow the mode
+			fprintf(stderr, "dynamic buffer: glMapBufferRange failed, using copies\n");
+			mode = COPY;
+			staging.resize(region_bytes);
+		}
+		return &staging[0];
+	}
+
+	/* Done writing - the region can be used by draws from now on */
+	void end ()
+	{
+		if (mode == MAP_RANGE) {
+			glBindBuffer(target, buffer);
+			glUnmapBuffer(target);
+		}
+		else if (mode == COPY) {
+			glBindBuffer(target, buffer);
+			glBufferSubData(target, offset(), region_bytes, &staging[0]);
+		}
+	}
+
+	/* Call after the last draw that reads the current region */
+	void fence ()
+	{
+		// glBufferSubData is ordered by the driver, nothing to wait for
+		if (mode != COPY)
+			fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	GLuint name () const { return buffer; }
+	Mode currentMode () const { return mode; }
+	GLintptr offset () const { return region * region_bytes; }
+	size_t regionBytes () const { return region_bytes; }
+	size_t totalBytes () const { return REGIONS * region_bytes; }
+	int waitCount () const { return waits; }	// frames that had to wait for the GPU
+
+private:
+	GLuint buffer;
+	GLenum target;
+	Mode mode;
+	size_t region_bytes;
+	int region;
+	char* mapped;	// the whole buffer, PERSISTENT only
+	std::vector<char> staging;
+	GLsync fences[REGIONS];
+	int waits;
+};
+
+#endif
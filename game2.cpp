@@ -2,6 +2,8 @@
 #include <cmath>
 #include <fstream>
 #include <vector>
+#include <future>
+#include <chrono>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -11,16 +13,39 @@
 #include <glm/gtx/transform.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "trace.h"
+#include "profiler.h"
+#include "glhook.h"
+#include "resources.h"
+#include "mesh.h"
+#include "moves.h"
+#include "transform.h"
+#include "camera.h"
+#include "dynbuffer.h"
+#include "procedural.h"
+#include "arena.h"
+#include "meshcache.h"
+#include "handles.h"
+#include "boardmesh.h"
+#include "staticlayer.h"
+#include "damage.h"
+#ifdef ENABLE_HEADLESS
+#include "headless.h"
+#endif
+
 using namespace std;
 
 struct VAO {
-	GLuint VertexArrayID;
-	GLuint VertexBuffer;
-	GLuint ColorBuffer;
+	GLuint VertexArrayID;	// the arena page's, shared with every mesh on that page
+	ArenaRange Range;
 
 	GLenum PrimitiveMode;
 	GLenum FillMode;
 	int NumVertices;
+
+	MeshKey Key;	// content, for the mesh cache
+	int References;	// objects sharing this mesh
+	Handle Self;	// in the meshes pool
 };
 typedef struct VAO VAO;
 
@@ -28,73 +53,225 @@ struct GLMatrices {
 	glm::mat4 projection;
 	glm::mat4 model;
 	glm::mat4 view;
-	GLuint MatrixID;
+	GLuint MatrixID;	// VP
+	GLuint ObjectID;	// index into the Objects block
 } Matrices;
 
 GLuint programID;
 
-/* Function to load Shaders - Use it as it is */
-GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path) {
+// Last MVP column and palette of every object, rewritten each frame and
+// read by the vertex shader's Objects uniform block
+const int MAX_SCENE_OBJECTS = 256;	// MAX_OBJECTS in Sample_GL.vert
+const GLuint OBJECTS_BINDING = 0;
+DynamicBuffer object_columns;
+bool buffer_storage = true;	// persistent mapping if the driver has it, off with --no-buffer-storage
+
+// Face colours of the meshes: vertices only store their face number, each
+// object picks a palette of six colours (one palette per BoxType)
+const int MAX_PALETTES = 4;	// MAX_PALETTES in Sample_GL.vert
+const GLuint PALETTE_BINDING = 1;
+GLuint palette_buffer = 0;
+static_assert(NUM_BOX_TYPES <= MAX_PALETTES, "more box types than palettes");
+
+// How the scene is drawn (--render): a draw per object from the mesh arena, every
+// box in one instanced draw without vertex buffers, or one point per tile
+// expanded by a geometry shader (procedural.h)
+enum RenderMode { RENDER_MESHES, RENDER_PROCEDURAL, RENDER_POINTS, NUM_RENDER_MODES };
+const char* render_mode_names[NUM_RENDER_MODES] = { "meshes", "procedural", "points" };
+const char* render_mode_defines[NUM_RENDER_MODES] = { "", "#define PROCEDURAL\n", "#define POINTS\n" };	// for Sample_GL.vert
+RenderMode render_mode = RENDER_MESHES;
+ProceduralBoxes procedural_boxes;
+TilePoints tile_points;
+
+// Vertex data of every mesh (arena.h), and its pages already in the registry
+MeshArena mesh_arena;
+int registered_arena_pages = 0;
+// Meshes by content, so identical objects share one upload (meshcache.h)
+MeshCache<struct VAO> mesh_cache;
+// Every mesh, reached through generational handles, and what waits for the
+// GPU before it can be freed (handles.h)
+HandlePool<struct VAO> meshes;
+DeferredDeletes deferred_deletes;
+
+// What the last draw3DObject left bound, so objects sharing it skip the calls
+GLuint bound_vertex_array = 0;
+GLenum bound_fill_mode = 0;
+
+// Framebuffer that stands for the window: 0, or the FBO of the headless backend
+GLuint default_framebuffer = 0;
+
+// Board and obstacles as rendered for the current camera, the frame is this
+// layer with the person drawn on top (staticlayer.h). Off with --no-static-layer
+StaticLayer static_layer;
+bool static_layer_enabled = true;
+bool static_layer_checked = false;	// the first blit showed the depth formats match
+
+// Partial redraws (damage.h): when the framebuffer keeps its contents between
+// frames (the headless FBO - a window's back buffer is undefined after a
+// swap), a frame that reuses the static layer only redraws where the person
+// was and is. Off with --no-partial-redraw
+bool partial_redraw_enabled = true;
+DamageRegion frame_damage;
+ScreenRect person_rect = { 0, 0, 0, 0 };	// where the person was drawn last
+double damaged_pixels = 0;	// redrawn, over all frames, for the report
+int damage_frames = 0;
+
+// Per-frame timing, enabled with --profile
+FrameProfiler frame_profiler;
+const double PROFILE_REPORT_INTERVAL = 5; // seconds
+bool gl_stats = false; // print GL calls per frame on exit (--gl-stats)
+
+// On-demand rendering (--on-demand): instead of drawing at the display rate
+// the loop sleeps in glfwWaitEventsTimeout until input, a resize, an animation
+// or a scheduled timer asks for a frame
+bool on_demand = false;
+bool redraw_requested = true;
+double redraw_at = HUGE_VAL;	// earliest scheduled frame, getTime() seconds
+double idle_seconds = 0;	// spent asleep, for the idle percentage
+double on_demand_start = 0;
+int on_demand_frames = 0;	// drawn since on_demand_start
+
+// Every GL object and mesh allocation, checked for leaks at shutdown
+ResourceRegistry resources;
+bool resource_report = false; // print the registry after startup and on exit (--resources)
+
+/* Shader sources read from disk - loaded on a worker thread during startup */
+struct ShaderSources {
+	std::string VertexPath;
+	std::string FragmentPath;
+	std::string GeometryPath;	// empty when there is no geometry shader
+	std::string VertexCode;
+	std::string FragmentCode;
+	std::string GeometryCode;
+};
 
-	// Create the shaders
-	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+/* Shaders submitted for compilation but not yet checked and linked */
+struct PendingProgram {
+	GLuint VertexShaderID;
+	GLuint FragmentShaderID;
+	GLuint GeometryShaderID;	// 0 when there is none
+	std::string VertexPath;
+	std::string FragmentPath;
+	std::string GeometryPath;
+};
+
+/* Read the code of a shader file - no GL calls, safe to use from any thread */
+std::string readShaderFile(const char * file_path) {
 
-	// Read the Vertex Shader code from the file
-	std::string VertexShaderCode;
-	std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-	if(VertexShaderStream.is_open())
+	std::string ShaderCode;
+	std::ifstream ShaderStream(file_path, std::ios::in);
+	if(ShaderStream.is_open())
 	{
 		std::string Line = "";
-		while(getline(VertexShaderStream, Line))
-			VertexShaderCode += "\n" + Line;
-		VertexShaderStream.close();
+		while(getline(ShaderStream, Line))
+			ShaderCode += "\n" + Line;
+		ShaderStream.close();
 	}
+	return ShaderCode;
+}
 
-	// Read the Fragment Shader code from the file
-	std::string FragmentShaderCode;
-	std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-	if(FragmentShaderStream.is_open()){
-		std::string Line = "";
-		while(getline(FragmentShaderStream, Line))
-			FragmentShaderCode += "\n" + Line;
-		FragmentShaderStream.close();
+/* Put #define lines right after the #version line, which has to come first */
+std::string addShaderDefines(const std::string& code, const std::string& defines) {
+
+	size_t version = code.find("#version");
+	size_t line_end = version == std::string::npos ? std::string::npos : code.find('\n', version);
+	if (line_end == std::string::npos)
+		return defines + code;
+	return code.substr(0, line_end + 1) + defines + code.substr(line_end + 1);
+}
+
+ShaderSources readShaderSources(const char * vertex_file_path,const char * fragment_file_path, const char * vertex_defines = "", const char * geometry_file_path = NULL) {
+
+	ShaderSources sources;
+	sources.VertexPath = vertex_file_path;
+	sources.FragmentPath = fragment_file_path;
+	sources.VertexCode = addShaderDefines(readShaderFile(vertex_file_path), vertex_defines);
+	sources.FragmentCode = readShaderFile(fragment_file_path);
+	if (geometry_file_path != NULL) {
+		sources.GeometryPath = geometry_file_path;
+		sources.GeometryCode = readShaderFile(geometry_file_path);
 	}
+	return sources;
+}
 
-	GLint Result = GL_FALSE;
-	int InfoLogLength;
+/* Submit the shaders for compilation. Drivers may compile in the background,
+   so the status is only checked in linkShaders() after other GL work is queued */
+PendingProgram compileShaders(const ShaderSources& sources) {
+
+	PendingProgram pending;
+	pending.VertexPath = sources.VertexPath;
+	pending.FragmentPath = sources.FragmentPath;
+	pending.GeometryPath = sources.GeometryPath;
+	pending.GeometryShaderID = 0;
+
+	// Create the shaders
+	pending.VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
+	pending.FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+	resources.add(ResourceRegistry::SHADER, pending.VertexShaderID, sources.VertexCode.size(), "vertex shader");
+	resources.add(ResourceRegistry::SHADER, pending.FragmentShaderID, sources.FragmentCode.size(), "fragment shader");
 
 	// Compile Vertex Shader
-	printf("Compiling shader : %s\n", vertex_file_path);
-	char const * VertexSourcePointer = VertexShaderCode.c_str();
-	glShaderSource(VertexShaderID, 1, &VertexSourcePointer , NULL);
-	glCompileShader(VertexShaderID);
+	printf("Compiling shader : %s\n", sources.VertexPath.c_str());
+	char const * VertexSourcePointer = sources.VertexCode.c_str();
+	glShaderSource(pending.VertexShaderID, 1, &VertexSourcePointer , NULL);
+	glCompileShader(pending.VertexShaderID);
+
+	// Compile Fragment Shader
+	printf("Compiling shader : %s\n", sources.FragmentPath.c_str());
+	char const * FragmentSourcePointer = sources.FragmentCode.c_str();
+	glShaderSource(pending.FragmentShaderID, 1, &FragmentSourcePointer , NULL);
+	glCompileShader(pending.FragmentShaderID);
+
+	// Compile Geometry Shader, if there is one
+	if (!sources.GeometryPath.empty()) {
+		pending.GeometryShaderID = glCreateShader(GL_GEOMETRY_SHADER);
+		resources.add(ResourceRegistry::SHADER, pending.GeometryShaderID, sources.GeometryCode.size(), "geometry shader");
+		printf("Compiling shader : %s\n", sources.GeometryPath.c_str());
+		char const * GeometrySourcePointer = sources.GeometryCode.c_str();
+		glShaderSource(pending.GeometryShaderID, 1, &GeometrySourcePointer , NULL);
+		glCompileShader(pending.GeometryShaderID);
+	}
+
+	return pending;
+}
+
+/* Check the compiled shaders and link them into a program */
+GLuint linkShaders(const PendingProgram& pending) {
+
+	GLint Result = GL_FALSE;
+	int InfoLogLength;
 
 	// Check Vertex Shader
-	glGetShaderiv(VertexShaderID, GL_COMPILE_STATUS, &Result);
-	glGetShaderiv(VertexShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	std::vector<char> VertexShaderErrorMessage(InfoLogLength);
-	glGetShaderInfoLog(VertexShaderID, InfoLogLength, NULL, &VertexShaderErrorMessage[0]);
+	glGetShaderiv(pending.VertexShaderID, GL_COMPILE_STATUS, &Result);
+	glGetShaderiv(pending.VertexShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+	std::vector<char> VertexShaderErrorMessage( max(InfoLogLength, int(1)) );
+	glGetShaderInfoLog(pending.VertexShaderID, InfoLogLength, NULL, &VertexShaderErrorMessage[0]);
 	fprintf(stdout, "%s\n", &VertexShaderErrorMessage[0]);
 
-	// Compile Fragment Shader
-	printf("Compiling shader : %s\n", fragment_file_path);
-	char const * FragmentSourcePointer = FragmentShaderCode.c_str();
-	glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer , NULL);
-	glCompileShader(FragmentShaderID);
-
 	// Check Fragment Shader
-	glGetShaderiv(FragmentShaderID, GL_COMPILE_STATUS, &Result);
-	glGetShaderiv(FragmentShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	std::vector<char> FragmentShaderErrorMessage(InfoLogLength);
-	glGetShaderInfoLog(FragmentShaderID, InfoLogLength, NULL, &FragmentShaderErrorMessage[0]);
+	glGetShaderiv(pending.FragmentShaderID, GL_COMPILE_STATUS, &Result);
+	glGetShaderiv(pending.FragmentShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+	std::vector<char> FragmentShaderErrorMessage( max(InfoLogLength, int(1)) );
+	glGetShaderInfoLog(pending.FragmentShaderID, InfoLogLength, NULL, &FragmentShaderErrorMessage[0]);
 	fprintf(stdout, "%s\n", &FragmentShaderErrorMessage[0]);
 
+	// Check Geometry Shader
+	if (pending.GeometryShaderID != 0) {
+		glGetShaderiv(pending.GeometryShaderID, GL_COMPILE_STATUS, &Result);
+		glGetShaderiv(pending.GeometryShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+		std::vector<char> GeometryShaderErrorMessage( max(InfoLogLength, int(1)) );
+		glGetShaderInfoLog(pending.GeometryShaderID, InfoLogLength, NULL, &GeometryShaderErrorMessage[0]);
+		fprintf(stdout, "%s\n", &GeometryShaderErrorMessage[0]);
+	}
+
 	// Link the program
 	fprintf(stdout, "Linking program\n");
 	GLuint ProgramID = glCreateProgram();
-	glAttachShader(ProgramID, VertexShaderID);
-	glAttachShader(ProgramID, FragmentShaderID);
+	resources.add(ResourceRegistry::PROGRAM, ProgramID, 0, "program");
+	glAttachShader(ProgramID, pending.VertexShaderID);
+	glAttachShader(ProgramID, pending.FragmentShaderID);
+	if (pending.GeometryShaderID != 0)
+		glAttachShader(ProgramID, pending.GeometryShaderID);
 	glLinkProgram(ProgramID);
 
 	// Check the program
@@ -104,99 +281,213 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
 	glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
 	fprintf(stdout, "%s\n", &ProgramErrorMessage[0]);
 
-	glDeleteShader(VertexShaderID);
-	glDeleteShader(FragmentShaderID);
+	glDeleteShader(pending.VertexShaderID);
+	glDeleteShader(pending.FragmentShaderID);
+	resources.remove(ResourceRegistry::SHADER, pending.VertexShaderID);
+	resources.remove(ResourceRegistry::SHADER, pending.FragmentShaderID);
+	if (pending.GeometryShaderID != 0) {
+		glDeleteShader(pending.GeometryShaderID);
+		resources.remove(ResourceRegistry::SHADER, pending.GeometryShaderID);
+	}
 
 	return ProgramID;
 }
 
+/* Function to load Shaders - Use it as it is */
+GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path) {
+	return linkShaders(compileShaders(readShaderSources(vertex_file_path, fragment_file_path)));
+}
+
 static void error_callback(int error, const char* description)
 {
 	fprintf(stderr, "Error: %s\n", description);
 }
 
+double getTime ();
+
+/* Share of the run spent asleep in on-demand mode */
+void printIdle ()
+{
+	double seconds = getTime() - on_demand_start;
+	printf("ON DEMAND: %d frames in %.1f s, idle %.1f%%\n", on_demand_frames, seconds,
+			seconds > 0 ? 100 * idle_seconds / seconds : 0.0);
+}
+
+/* Print the frame time percentiles over the whole run */
+void reportProfile()
+{
+	if (frame_profiler.isEnabled())
+		FrameProfiler::print("frame profile (whole run)", frame_profiler.totals());
+	if (frame_profiler.isEnabled() && object_columns.name() != 0)
+		cout << "dynamic buffer (" << DynamicBuffer::modeName(object_columns.currentMode()) << "): "
+			<< object_columns.waitCount() << " frames waited for the GPU" << endl;
+	if (gl_stats)
+		printGLHookReport();
+	if (on_demand)
+		printIdle();
+	if (frame_profiler.isEnabled() && damage_frames > 0 && static_layer.Width > 0)
+		printf("damage: %.2f%% of the pixels redrawn per frame\n",
+				100 * damaged_pixels / damage_frames / ((double) static_layer.Width * static_layer.Height));
+}
+
+/* Ask for a frame - in on-demand mode nothing is drawn until something does */
+void requestRedraw ()
+{
+	redraw_requested = true;
+}
+
+/* Ask for a frame at 'at' seconds (getTime), e.g. for a timer */
+void scheduleRedraw (double at)
+{
+	redraw_at = min(redraw_at, at);
+}
+
+/* On-demand mode: sleep until a callback, an animation or a timer asks for a frame */
+void waitForRedraw (GLFWwindow* window)
+{
+	double start = getTime();
+	while (!redraw_requested && !glfwWindowShouldClose(window)) {
+		double now = getTime();
+		if (now >= redraw_at)
+			break;
+		if (redraw_at == HUGE_VAL)
+			glfwWaitEvents();
+		else
+			glfwWaitEventsTimeout(redraw_at - now);
+	}
+	double now = getTime();
+	if (now >= redraw_at)
+		redraw_at = HUGE_VAL;
+	redraw_requested = false;
+	idle_seconds += now - start;
+}
+
+/* Seconds since the first call - glfwGetTime is not available in headless mode */
+double getTime ()
+{
+	static chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+void destroyObjects();
+
+/* Free everything the game created and list what was missed */
+void releaseResources()
+{
+	destroyObjects();
+	if (frame_profiler.isEnabled()) {
+		for (int i = 0; i < FrameProfiler::queryCount(); i++)
+			resources.remove(ResourceRegistry::QUERY, frame_profiler.query(i));
+		frame_profiler.destroy();
+	}
+	if (resource_report)
+		resources.print();
+	resources.reportLeaks();
+}
+
 void quit(GLFWwindow *window)
 {
+	reportProfile();
+	releaseResources();
 	glfwDestroyWindow(window);
 	glfwTerminate();
 	exit(EXIT_SUCCESS);
 }
 
 
-/* Generate VAO, VBOs and return VAO handle */
-struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat* color_buffer_data, GLenum fill_mode=GL_FILL)
+/* Put the arena's new pages in the registry */
+void registerArenaPages ()
+{
+	for (; registered_arena_pages < mesh_arena.pageCount(); registered_arena_pages++) {
+		resources.add(ResourceRegistry::VERTEX_ARRAY, mesh_arena.vertexArray(registered_arena_pages), 0, "mesh arena");
+		resources.add(ResourceRegistry::BUFFER, mesh_arena.buffer(registered_arena_pages), mesh_arena.pageBytes(registered_arena_pages), "mesh arena");
+	}
+}
+
+/* Copy a mesh into the arena and return its VAO handle - or another reference
+   to an earlier mesh with the same content. Colours come from the palette
+   the object is drawn with, 'face_buffer_data' picks the entry per vertex */
+Handle create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLubyte* face_buffer_data, GLenum fill_mode=GL_FILL, const char* label="object")
 {
+	MeshKey key = meshKey(primitive_mode, fill_mode, numVertices, vertex_buffer_data, face_buffer_data);
+	struct VAO* shared = mesh_cache.find(key, vertex_buffer_data, face_buffer_data);
+	if (shared != NULL) {
+		shared->References++;
+		return shared->Self;
+	}
+
 	struct VAO* vao = new struct VAO;
+	resources.add(ResourceRegistry::MESH_HEAP, (uintptr_t) vao, sizeof(struct VAO), label);
 	vao->PrimitiveMode = primitive_mode;
 	vao->NumVertices = numVertices;
 	vao->FillMode = fill_mode;
+	vao->Key = key;
+	vao->References = 1;
+	mesh_cache.insert(key, vertex_buffer_data, face_buffer_data, vao);
 
-	// Create Vertex Array Object
+	// A range of a shared vertex buffer - no VAO or VBO of its own
 	// Should be done after CreateWindow and before any other GL calls
-	glGenVertexArrays(1, &(vao->VertexArrayID)); // VAO
-	glGenBuffers (1, &(vao->VertexBuffer)); // VBO - vertices
-	glGenBuffers (1, &(vao->ColorBuffer));  // VBO - colors
+	vao->Range = mesh_arena.allocate(vertex_buffer_data, face_buffer_data, numVertices);
+	vao->VertexArrayID = mesh_arena.vertexArray(vao->Range.Page);
+	registerArenaPages();
 
-	glBindVertexArray (vao->VertexArrayID); // Bind the VAO 
-	glBindBuffer (GL_ARRAY_BUFFER, vao->VertexBuffer); // Bind the VBO vertices 
-	glBufferData (GL_ARRAY_BUFFER, 3*numVertices*sizeof(GLfloat), vertex_buffer_data, GL_STATIC_DRAW); // Copy the vertices into VBO
-	glVertexAttribPointer(
-			0,                  // attribute 0. Vertices
-			3,                  // size (x,y,z)
-			GL_FLOAT,           // type
-			GL_FALSE,           // normalized?
-			0,                  // stride
-			(void*)0            // array buffer offset
-			);
+	vao->Self = meshes.insert(vao);
+	return vao->Self;
+}
 
-	glBindBuffer (GL_ARRAY_BUFFER, vao->ColorBuffer); // Bind the VBO colors 
-	glBufferData (GL_ARRAY_BUFFER, 3*numVertices*sizeof(GLfloat), color_buffer_data, GL_STATIC_DRAW);  // Copy the vertex colors
-	glVertexAttribPointer(
-			1,                  // attribute 1. Color
-			3,                  // size (r,g,b)
-			GL_FLOAT,           // type
-			GL_FALSE,           // normalized?
-			0,                  // stride
-			(void*)0            // array buffer offset
-			);
+/* Upload a mesh generated at compile time (see mesh.h) and return VAO handle */
+template <typename Mesh>
+Handle create3DObject (Mesh, const char* label="object")
+{
+	return create3DObject(Mesh::PrimitiveMode, Mesh::NumVertices, Mesh::Vertices.data(), Mesh::Faces.data(), Mesh::FillMode, label);
+}
 
-	return vao;
+/* Drop a reference, the last one removes the mesh - its handles go stale at
+   once, its arena range is given back when the GPU is done with it. Stale
+   and empty handles are ignored */
+void destroy3DObject (Handle handle)
+{
+	struct VAO* vao = meshes.get(handle);
+	if (vao == NULL || --vao->References > 0)
+		return;
+	meshes.remove(handle);
+	mesh_cache.erase(vao->Key, vao);
+	ArenaRange range = vao->Range;
+	deferred_deletes.defer([range] { mesh_arena.release(range); });
+	resources.remove(ResourceRegistry::MESH_HEAP, (uintptr_t) vao);
+	delete vao;
 }
 
-/* Generate VAO, VBOs and return VAO handle - Common Color for all vertices */
-struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat red, const GLfloat green, const GLfloat blue, GLenum fill_mode=GL_FILL)
+/* Bulk teardown: remove every mesh still in the pool, however many references
+   are left, and wait for the GPU so their ranges are free */
+void destroyAll3DObjects ()
 {
-	GLfloat* color_buffer_data = new GLfloat [3*numVertices];
-	for (int i=0; i<numVertices; i++) {
-		color_buffer_data [3*i] = red;
-		color_buffer_data [3*i + 1] = green;
-		color_buffer_data [3*i + 2] = blue;
+	vector<Handle> live = meshes.handles();
+	for (size_t i = 0; i < live.size(); i++) {
+		meshes.get(live[i])->References = 1;
+		destroy3DObject(live[i]);
 	}
-
-	return create3DObject(primitive_mode, numVertices, vertex_buffer_data, color_buffer_data, fill_mode);
+	deferred_deletes.flush();
 }
 
 /* Render the VBOs handled by VAO */
 void draw3DObject (struct VAO* vao)
 {
 	// Change the Fill Mode for this object
-	glPolygonMode (GL_FRONT_AND_BACK, vao->FillMode);
-
-	// Bind the VAO to use
-	glBindVertexArray (vao->VertexArrayID);
-
-	// Enable Vertex Attribute 0 - 3d Vertices
-	glEnableVertexAttribArray(0);
-	// Bind the VBO to use
-	glBindBuffer(GL_ARRAY_BUFFER, vao->VertexBuffer);
+	if (vao->FillMode != bound_fill_mode) {
+		glPolygonMode (GL_FRONT_AND_BACK, vao->FillMode);
+		bound_fill_mode = vao->FillMode;
+	}
 
-	// Enable Vertex Attribute 1 - Color
-	glEnableVertexAttribArray(1);
-	// Bind the VBO to use
-	glBindBuffer(GL_ARRAY_BUFFER, vao->ColorBuffer);
+	// Bind the VAO to use - the attributes and buffer were set up with the arena page
+	if (vao->VertexArrayID != bound_vertex_array) {
+		glBindVertexArray (vao->VertexArrayID);
+		bound_vertex_array = vao->VertexArrayID;
+	}
 
-	// Draw the geometry !
-	glDrawArrays(vao->PrimitiveMode, 0, vao->NumVertices); // Starting from vertex 0; 3 vertices total -> 1 triangle
+	// Draw the geometry ! Starting from the object's first vertex in the page
+	glDrawArrays(vao->PrimitiveMode, vao->Range.First, vao->NumVertices);
+	frame_profiler.countDrawCall();
 }
 
 /**************************
@@ -207,17 +498,23 @@ float triangle_rot_dir = 1;
 float rectangle_rot_dir = 1;
 bool triangle_rot_status = true;
 bool rectangle_rot_status = true;
-float person_posx=-4.5,person_posz=-4.5,person_posy=1;
-int block_pos=99;
-int lives=3;
-bool jump=false;
-float kn = -8.0 , kp = 8.0 , on = -8.0 , op = 8.0 ;
-float eyeview=-1,targetview=6,upview=1;
+PersonState player = { -4.5, 1, -4.5, 99, 3, false };
+Camera camera;
+
+/* Apply an arrow key move and report it on the console */
+void movePerson (MoveDirection direction)
+{
+	if (resolveMove(player, direction) == MOVE_FELL)
+		cout<<"fallen into pit \nlost life"<<endl;
+	cout<<"block "<<player.BlockPos<<endl;
+}
+
 /* Executed when a regular key is pressed/released/held-down */
 /* Prefered for Keyboard events */
 void keyboard (GLFWwindow* window, int key, int scancode, int action, int mods)
 {
 	// Function is called first on GLFW_PRESS.
+	requestRedraw();
 
 	/*if (action == GLFW_RELEASE) {
 	  switch (key) {
@@ -249,214 +546,62 @@ void keyboard (GLFWwindow* window, int key, int scancode, int action, int mods)
 		switch(key)
 		{
 			case GLFW_KEY_RIGHT:
-				if(jump==true)
-				{
-					if(person_posz<3.5)
-					{
-						person_posz+=2;
-						block_pos-=2;
-						if(block_pos%8==5)
-						{
-							cout<<"fallen into pit \nlost life"<<endl;
-							block_pos=99;
-							person_posy=0;
-							lives--;
-						}
-						else if(block_pos%6==1)
-						{
-							person_posz-=2;
-							block_pos+=2;
-						}
-					}
-					jump=false;
-				}
-				else if(person_posz<4.5)
-				{
-					person_posz++;
-					block_pos--;
-					if(block_pos%8==5)
-					{
-						cout<<"fallen into pit \nlost life"<<endl;
-						block_pos=99;
-						person_posy=0;
-						lives--;
-					}
-					else if(block_pos%6==1)
-					{
-						person_posz--;
-						block_pos++;
-					}
-				}
-				cout<<"block "<<block_pos<<endl;
+				movePerson(MOVE_RIGHT);
 				break;
 
 			case GLFW_KEY_LEFT:
-				if(jump==true)
-				{
-					if(person_posz>-3.5)
-					{
-						person_posz-=2;
-						block_pos+=2;
-						if(block_pos%8==5)
-						{
-							cout<<"fallen into pit \nlost life"<<endl;
-							block_pos=99;
-							person_posy=0;
-							lives--;
-						}
-						else if(block_pos%6==1)
-						{
-							person_posz+=2;
-							block_pos-=2;
-						}
-					}
-					jump=false;
-				}
-				else if(person_posz>-4.5)
-				{
-					person_posz--;
-					block_pos++;
-					if(block_pos%8==5)
-					{
-						cout<<"fallen into pit \nlost life"<<endl;
-						block_pos=99;
-						person_posy=0;
-						lives--;
-					}
-					else if(block_pos%6==1)
-					{
-						person_posz++;
-						block_pos--;
-					}
-
-				}
-				cout<<"block "<<block_pos<<endl;
+				movePerson(MOVE_LEFT);
 				break;
 
 			case GLFW_KEY_UP:
-				if(jump==true)
-				{
-					if(person_posx<3.5)
-					{
-						person_posx+=2;
-						block_pos-=20;
-						if(block_pos%8==5)
-						{
-							cout<<"fallen into pit \nlost life"<<endl;
-							block_pos=99;
-							person_posy=0;
-							lives--;
-						}
-						else if(block_pos%6==1)
-						{
-							person_posx-=2;
-							block_pos+=20;
-						}
-					}
-					jump=false;
-				}
-				else if(person_posx<4.5)
-				{
-					person_posx++;
-					block_pos-=10;
-					if(block_pos%8==5)
-					{
-						cout<<"fallen into pit \nlost life"<<endl;
-						block_pos=99;
-						person_posy=0;
-						lives--;
-					}
-					else if(block_pos%6==1)
-					{
-						person_posx--;
-						block_pos+=10;
-					}
-				}
-				cout<<"block "<<block_pos<<endl;
+				movePerson(MOVE_UP);
 				break;
 
 			case GLFW_KEY_DOWN:
-				if(jump==true)
-				{
-					if(person_posx>-3.5)
-					{
-						person_posx-=2;
-						block_pos+=20;
-						if(block_pos%8==5)
-						{
-							cout<<"fallen into pit \nlost life"<<endl;
-							block_pos=99;
-							person_posy=0;
-							lives--;
-						}
-						else if(block_pos%6==1)
-						{
-							person_posx+=2;
-							block_pos-=20;
-						}
-					}
-					jump=false;
-				}
-				else if(person_posx>-4.5)
-				{
-					person_posx--;
-					block_pos+=10;
-					if(block_pos%8==5)
-					{
-						cout<<"fallen into pit \nlost life"<<endl;
-						block_pos=99;
-						person_posy=0;
-						lives--;
-					}
-					else if(block_pos%6==1)
-					{
-						person_posx++;
-						block_pos-=10;
-					}
-				}
-				cout<<"block "<<block_pos<<endl;
+				movePerson(MOVE_DOWN);
 				break;
 
 			case GLFW_KEY_SPACE:
-				jump=true;
+				player.Jump=true;
 				break;
 
 			case GLFW_KEY_A:
-				eyeview=-6;
-				targetview=6;
-				upview=6;
+				camera.setEye(glm::vec3(-6,6,6));
 				break;
 
 			case GLFW_KEY_S:
-				eyeview=-1;
-				targetview=6;
-				upview=1;
+				camera.setEye(glm::vec3(-1,6,1));
 				break;
 			case GLFW_KEY_Z:
-				op/=1.25;
-				on/=1.25;
-				kp/=1.25;
-				kn/=1.25;
+				camera.zoomBy(1/1.25f, getTime());
 				break;
 		
 			case GLFW_KEY_O:
-				op*=2.5;
-				on*=2.5;
-				kp*=2.5;
-				kn*=2.5;
+				camera.zoomBy(2.5f, getTime());
 				break;
 		}
 	}
 }
 
+void reloadLevel ();
+
 /* Executed for character input (like in text boxes) */
 void keyboardChar (GLFWwindow* window, unsigned int key)
 {
+	requestRedraw();
 	switch (key) {
 		case 'Q':
 		case 'q':
 			quit(window);
 			break;
+		case 'M':
+		case 'm':
+			resources.print();
+			break;
+		case 'R':
+		case 'r':
+			reloadLevel();
+			break;
 		default:
 			break;
 	}
@@ -465,6 +610,7 @@ void keyboardChar (GLFWwindow* window, unsigned int key)
 /* Executed when a mouse button is pressed/released */
 void mouseButton (GLFWwindow* window, int button, int action, int mods)
 {
+	requestRedraw();
 	switch (button) {
 		case GLFW_MOUSE_BUTTON_LEFT:
 			if (action == GLFW_RELEASE)
@@ -481,14 +627,41 @@ void mouseButton (GLFWwindow* window, int button, int action, int mods)
 }
 
 
+/* (Re)create the static layer for a framebuffer of 'width' x 'height' - it is
+   rendered again on the next frame */
+void sizeStaticLayer (int width, int height)
+{
+	if (static_layer.Framebuffer != 0) {
+		if (static_layer.Width == width && static_layer.Height == height)
+			return;
+		resources.remove(ResourceRegistry::FRAMEBUFFER, static_layer.Framebuffer);
+		resources.remove(ResourceRegistry::RENDERBUFFER, static_layer.ColorBuffer);
+		resources.remove(ResourceRegistry::RENDERBUFFER, static_layer.DepthBuffer);
+	}
+	// The depth formats have to match for the blit, see staticlayer.h
+	GLenum depth_format = default_framebuffer != 0 ? GL_DEPTH_COMPONENT24 : GL_DEPTH24_STENCIL8;
+	bool complete = resizeStaticLayer(static_layer, width, height, depth_format);
+	glBindFramebuffer(GL_FRAMEBUFFER, default_framebuffer);
+	if (!complete) {
+		destroyStaticLayer(static_layer);
+		static_layer_enabled = false;
+		return;
+	}
+	resources.add(ResourceRegistry::FRAMEBUFFER, static_layer.Framebuffer, 0, "static layer");
+	resources.add(ResourceRegistry::RENDERBUFFER, static_layer.ColorBuffer, 4 * width * height, "static layer color");
+	resources.add(ResourceRegistry::RENDERBUFFER, static_layer.DepthBuffer, 4 * width * height, "static layer depth");
+}
+
 /* Executed when window is resized to 'width' and 'height' */
 /* Modify the bounds of the screen here in glm::ortho or Field of View in glm::Perspective */
 void reshapeWindow (GLFWwindow* window, int width, int height)
 {
+	requestRedraw();
 	int fbwidth=width, fbheight=height;
 	/* With Retina display on Mac OS X, GLFW's FramebufferSize
 	   is different from WindowSize */
-	glfwGetFramebufferSize(window, &fbwidth, &fbheight);
+	if (window != NULL)
+		glfwGetFramebufferSize(window, &fbwidth, &fbheight);
 
 	GLfloat fov = 90.0f;
 
@@ -503,11 +676,72 @@ void reshapeWindow (GLFWwindow* window, int width, int height)
 	// Perspective projection for 3D views
 	// Matrices.projection = glm::perspective (fov, (GLfloat) fbwidth / (GLfloat) fbheight, 0.1f, 500.0f);
 
-	// Ortho projection for 2D views
-	Matrices.projection = glm::ortho(kn, kp, on, op, 0.1f, 500.0f);
+	// Ortho projection for 2D views - built by the camera when the eye or zoom changes
+
+	// The cached static layer has the framebuffer's size
+	if (render_mode == RENDER_MESHES && static_layer_enabled)
+		sizeStaticLayer(fbwidth, fbheight);
+}
+
+Handle triangle, rectangle, board, person, obstacle[100];
+
+/* Drop the level's references to its meshes */
+void releaseLevelObjects ()
+{
+	Handle* objects[] = { &triangle, &rectangle, &board, &person };
+	for (size_t i = 0; i < sizeof(objects) / sizeof(objects[0]); i++) {
+		destroy3DObject(*objects[i]);
+		*objects[i] = NO_HANDLE;
+	}
+	for (int i = 0; i < 100; i++) {
+		destroy3DObject(obstacle[i]);
+		obstacle[i] = NO_HANDLE;
+	}
 }
 
-VAO *triangle, *rectangle, *board[105], *person,*obstacle[100];
+/* Delete every object and the shader program - the context must still be current */
+void destroyObjects ()
+{
+	releaseLevelObjects();
+	destroyAll3DObjects();
+	for (int page = 0; page < mesh_arena.pageCount(); page++) {
+		resources.remove(ResourceRegistry::BUFFER, mesh_arena.buffer(page));
+		resources.remove(ResourceRegistry::VERTEX_ARRAY, mesh_arena.vertexArray(page));
+	}
+	mesh_arena.destroy();
+	registered_arena_pages = 0;
+	if (object_columns.name() != 0) {
+		resources.remove(ResourceRegistry::BUFFER, object_columns.name());
+		object_columns.destroy();
+	}
+	if (palette_buffer != 0) {
+		glDeleteBuffers(1, &palette_buffer);
+		resources.remove(ResourceRegistry::BUFFER, palette_buffer);
+		palette_buffer = 0;
+	}
+	if (procedural_boxes.VertexArray != 0) {
+		resources.remove(ResourceRegistry::TEXTURE, procedural_boxes.InstanceTexture);
+		resources.remove(ResourceRegistry::BUFFER, procedural_boxes.InstanceBuffer);
+		resources.remove(ResourceRegistry::VERTEX_ARRAY, procedural_boxes.VertexArray);
+		destroyProceduralBoxes(procedural_boxes);
+	}
+	if (tile_points.VertexArray != 0) {
+		resources.remove(ResourceRegistry::BUFFER, tile_points.PointBuffer);
+		resources.remove(ResourceRegistry::VERTEX_ARRAY, tile_points.VertexArray);
+		destroyTilePoints(tile_points);
+	}
+	if (static_layer.Framebuffer != 0) {
+		resources.remove(ResourceRegistry::FRAMEBUFFER, static_layer.Framebuffer);
+		resources.remove(ResourceRegistry::RENDERBUFFER, static_layer.ColorBuffer);
+		resources.remove(ResourceRegistry::RENDERBUFFER, static_layer.DepthBuffer);
+		destroyStaticLayer(static_layer);
+	}
+	if (programID != 0) {
+		glDeleteProgram(programID);
+		resources.remove(ResourceRegistry::PROGRAM, programID);
+		programID = 0;
+	}
+}
 
 // Creates the triangle object used in this sample code
 void createTriangle ()
@@ -521,207 +755,185 @@ void createTriangle ()
 		1,-1,0, // vertex 2
 	};
 
-	static const GLfloat color_buffer_data [] = {
-		1,0,0, // color 0
-		0,1,0, // color 1
-		0,0,1, // color 2
+	// Palette entry of each vertex - the colours are those of the palette it is drawn with
+	static const GLubyte face_buffer_data [] = {
+		0, // color 0
+		1, // color 1
+		2, // color 2
 	};
 
 	// create3DObject creates and returns a handle to a VAO that can be used later
-	triangle = create3DObject(GL_TRIANGLES, 3, vertex_buffer_data, color_buffer_data, GL_LINE);
+	triangle = create3DObject(GL_TRIANGLES, 3, vertex_buffer_data, face_buffer_data, GL_LINE, "triangle");
 }
 
-VAO* createPerson(float width,float length,float height,float r,float g, float b)
+Handle createPerson()
 {
-	GLfloat vertex_buffer_data [] = {
-		-width/2,-length/2,-height/2, // vertex 1
-		width/2,-length/2,-height/2, // vertex 2
-		width/2, length/2,height/2, // vertex 3
-
-		width/2, length/2,-height/2, // vertex 3
-		-width/2, length/2,-height/2, // vertex 4
-		-width/2,-length/2,-height/2 , // vertex 1
-
-		width/2,length/2,-height/2,
-		-width/2,length/2,-height/2,  
-		-width/2,length/2,height/2,
-
-		-width/2,length/2,height/2,
-		width/2,length/2,height/2,
-		width/2,length/2,-height/2,
-
-		width/2,length/2,height/2,
-		width/2,length/2,-height/2,
-		width/2,-length/2,-height/2,
-
-		width/2,-length/2,-height/2,
-		width/2,-length/2,height/2,
-		width/2,length/2,height/2,
-
-
-
-		-width/2,-length/2,-height/2,
-		width/2,-length/2,-height/2,
-		width/2,-length/2,height/2,
-
-		width/2,-length/2,height/2,
-		-width/2,-length/2,height/2,
-		-width/2,-length/2,-height/2,
-
-		width/2,length/2,height/2,
-		width/2,-length/2,height/2,
-		-width/2,-length/2,height/2,
-
-		-width/2,-length/2,height/2,
-		-width/2,length/2,height/2,
-		width/2,length/2,height/2,
-
-		-width/2,-length/2,-height/2,
-		-width/2,length/2,-height/2, 
-		-width/2,length/2,height/2,
-
-		-width/2,length/2,height/2,
-		-width/2,-length/2,height/2,
-		-width/2,-length/2,-height/2,
-	};
-	GLfloat color_buffer_data [100];
-	for(int i=0;i<12;i++)
-	{
-		color_buffer_data[3*i]=r;
-		color_buffer_data[(3*i)+1]=g;
-		color_buffer_data[(3*i)+2]=b;
-	}
-	return create3DObject(GL_TRIANGLES, 36, vertex_buffer_data, color_buffer_data, GL_FILL);
+	return create3DObject(PersonMesh(), "person");
 }
-VAO* createObstacle(float width,float length,float height,float r,float g,float b)
+Handle createObstacle()
 {
-	return createPerson(width,length,height,r,g,b);
+	return create3DObject(ObstacleMesh(), "obstacle");
 }
-// Creates the rectangle object used in this sample code
-VAO* createBoard (float width,float length, float height,float r, float g, float b)
+/* The board's tiles for the mesher: board index 0 is the tile centred on
+   (4.5, 0, 4.5), counting down z and then down x, like buildScene */
+TileGrid boardGrid ()
 {
-	// GL3 accepts only Triangles. Quads are not supported
-	GLfloat vertex_buffer_data [] = {
-		-width/2,-length/2,-height/2, // vertex 1
-		width/2,-length/2,-height/2, // vertex 2
-		width/2, length/2,height/2, // vertex 3
-
-		width/2, length/2,-height/2, // vertex 3
-		-width/2, length/2,-height/2, // vertex 4
-		-width/2,-length/2,-height/2 , // vertex 1
-
-		width/2,length/2,-height/2,
-		-width/2,length/2,-height/2,  
-		-width/2,length/2,height/2,
-
-		-width/2,length/2,height/2,
-		width/2,length/2,height/2,
-		width/2,length/2,-height/2,
-
-		width/2,length/2,height/2,
-		width/2,length/2,-height/2,
-		width/2,-length/2,-height/2,
-
-		width/2,-length/2,-height/2,
-		width/2,-length/2,height/2,
-		width/2,length/2,height/2,
-
-
-
-		-width/2,-length/2,-height/2,
-		width/2,-length/2,-height/2,
-		width/2,-length/2,height/2,
-
-		width/2,-length/2,height/2,
-		-width/2,-length/2,height/2,
-		-width/2,-length/2,-height/2,
-
-		width/2,length/2,height/2,
-		width/2,-length/2,height/2,
-		-width/2,-length/2,height/2,
-
-		-width/2,-length/2,height/2,
-		-width/2,length/2,height/2,
-		width/2,length/2,height/2,
-
-		-width/2,-length/2,-height/2,
-		-width/2,length/2,-height/2, 
-		-width/2,length/2,height/2,
-
-		-width/2,length/2,height/2,
-		-width/2,-length/2,height/2,
-		-width/2,-length/2,-height/2,
-	};
-//	0.6 - 0.1
-//	0.2 - 0.4
-//	1 - 0.9
-	GLfloat color_buffer_data []={
-
-		0.2, 0.1,0.7,
-		0.2, 0.1,0.7,
-		0.2, 0.1,0.7,
-
-		0.2, 0.1,0.7,
-		0.2, 0.1,0.7,
-		0.2, 0.1,0.7,
-
-		0.4,0.5,0.5,
-		0.4,0.5,0.5,
-		0.4,0.5,0.5,
-
-		0.4,0.5,0.5,
-		0.4,0.5,0.5,
-		0.4,0.5,0.5,
-
-		0.2,0.4,0.6,
-		0.2,0.4,0.6,
-		0.2,0.4,0.6,
-
-		0.2,0.4,0.6,
-		0.2,0.4,0.6,
-		0.2,0.4,0.6,
-
-		0.1,0.2,0.6,
-		0.1,0.2,0.6,
-		0.1,0.2,0.6,
+	TileGrid grid;
+	grid.SizeX = grid.SizeZ = 10;
+	grid.MinX = grid.MinZ = -5;
+	grid.MaxY = BoardMesh::size(1) / 2;
+	grid.MinY = -grid.MaxY;
+	grid.Solid.resize(grid.SizeX * grid.SizeZ);
+	for (int index = 0; index < 100; index++)
+		grid.Solid[(9 - index/10) * grid.SizeZ + 9 - index%10] = !isPit(index);
+	return grid;
+}
 
-		0.1,0.2,0.6,
-		0.1,0.2,0.6,
-		0.1,0.2,0.6,
+int board_triangles = 0;
 
-		0.1,0.7,0.7,
-		0.1,0.7,0.7,
-		0.1,0.7,0.7,
+// Creates the board: every tile in one mesh, without the faces between tiles (boardmesh.h)
+Handle createBoard ()
+{
+	BoardMeshData mesh;
+	buildBoardMesh(boardGrid(), mesh);
+	board_triangles = mesh.numVertices() / 3;
 
-		0.1,0.7,0.7,
-		0.1,0.7,0.7,
-		0.1,0.7,0.7,
+	// create3DObject creates and returns a handle to a VAO that can be used later
+	return create3DObject(GL_TRIANGLES, mesh.numVertices(), &mesh.Vertices[0], &mesh.Faces[0], GL_FILL, "board");
+}
 
-		0.4,0.4,0.4,
-		0.4,0.4,0.4,
-		0.4,0.4,0.4,
+// What draw() renders, in order, with the position of each object
+vector<Handle> scene_objects;	// NO_HANDLE when rendering procedurally
+vector<BoxType> scene_types;	// also the palette of each object
+TranslationBatch scene_positions;
+size_t person_slot;
+// The same scene as one point per tile, pits included, and the person last
+vector<TilePoint> scene_tiles;
+
+/* Lay out the board: tiles except pits, an obstacle on some tiles, then the
+   person. The mesh renderer draws all tiles as the one board mesh */
+void buildScene ()
+{
+	scene_objects.clear();
+	scene_types.clear();
+	scene_positions = TranslationBatch();
+	scene_tiles.clear();
+	bool board_mesh = render_mode == RENDER_MESHES;
+	if (board_mesh)
+	{
+		scene_objects.push_back(board);
+		scene_types.push_back(BOX_BOARD);
+		scene_positions.add(0, 0, 0);
+	}
+	int index=0,oindex=0;
+	for(float i=4.5;i>=-4.5;i--)
+	{
+		for(float j=4.5;j>=-4.5;j--)
+		{
+			TilePoint tile = { i, 0, j, (GLfloat) (isPit(index) ? TILE_PIT : index%6==1 ? TILE_OBSTACLE : TILE_FLOOR) };
+			scene_tiles.push_back(tile);
+			if(index%8!=5)
+			{
+				if (!board_mesh)
+				{
+					scene_objects.push_back(NO_HANDLE);
+					scene_types.push_back(BOX_BOARD);
+					scene_positions.add(i, 0, j);
+				}
+				if(index%6==1)
+				{
+					scene_objects.push_back(obstacle[oindex++]);
+					scene_types.push_back(BOX_OBSTACLE);
+					scene_positions.add(i, 1, j);
+				}
+			}
+			index++;
+		}
+	}
+	person_slot = scene_objects.size();
+	scene_objects.push_back(person);
+	scene_types.push_back(BOX_PERSON);
+	scene_positions.add(player.PosX, player.PosY, player.PosZ);
+	TilePoint person_tile = { player.PosX, player.PosY, player.PosZ, TILE_PERSON };
+	scene_tiles.push_back(person_tile);
+
+	if (render_mode == RENDER_MESHES && scene_objects.size() > (size_t) MAX_SCENE_OBJECTS) {
+		cerr << "scene has " << scene_objects.size() << " objects, the shader takes at most " << MAX_SCENE_OBJECTS << endl;
+		exit(EXIT_FAILURE);
+	}
+}
 
-		0.4,0.4,0.4,
-		0.4,0.4,0.4,
-		0.4,0.4,0.4,
+/* Create the level's objects - identical meshes are uploaded once */
+void createLevelObjects ()
+{
+	board=createBoard ();
 
+	for(int i=0;i<30;i++)
+	{
+		obstacle[i]=createObstacle ();
+	}
 
-	};
+	person=createPerson ();
+}
 
-	// create3DObject creates and returns a handle to a VAO that can be used later
-	return create3DObject(GL_TRIANGLES, 36, vertex_buffer_data, color_buffer_data, GL_FILL);
+/* Replace the level's objects with new ones ('R') - the old meshes are freed
+   once the GPU has finished the frames that drew them */
+void reloadLevel ()
+{
+	if (render_mode != RENDER_MESHES)
+		return;
+	releaseLevelObjects();
+	createLevelObjects();
+	buildScene();
+	static_layer.Valid = false;
+	cout << "level reloaded, " << meshes.size() << " meshes, " << deferred_deletes.pendingCount() << " waiting for the GPU" << endl;
 }
 
 float camera_rotation_angle = 90;
 float rectangle_rotation = 0;
 float triangle_rotation = 0;
 
+/* Draw scene object 'k' with its column of this frame's Objects block */
+void drawSceneObject (size_t k)
+{
+	struct VAO* vao = meshes.get(scene_objects[k]);
+	if (vao == NULL)
+		return;
+	glUniform1i(Matrices.ObjectID, k);
+
+	// draw3DObject draws the VAO given to it using current MVP matrix
+	draw3DObject(vao);
+}
+
+/* A blit between different depth formats fails - then the layer is dropped
+   and every frame is drawn in full, as with --no-static-layer. Call right
+   after the first blit, with the errors from before it drained */
+void checkStaticLayerBlit ()
+{
+	static_layer_checked = true;
+	if (glGetError() == GL_NO_ERROR)
+		return;
+	cerr << "static layer: cannot blit to this framebuffer, drawing every frame in full" << endl;
+	resources.remove(ResourceRegistry::FRAMEBUFFER, static_layer.Framebuffer);
+	resources.remove(ResourceRegistry::RENDERBUFFER, static_layer.ColorBuffer);
+	resources.remove(ResourceRegistry::RENDERBUFFER, static_layer.DepthBuffer);
+	destroyStaticLayer(static_layer);
+	static_layer_enabled = false;
+	glBindFramebuffer(GL_FRAMEBUFFER, default_framebuffer);
+	glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	for (size_t k = 0; k < scene_objects.size(); k++)
+		if (k != person_slot)
+			drawSceneObject(k);
+}
+
 /* Render the scene with openGL */
 /* Edit this function according to your assignment */
 void draw ()
 {
-	// clear the color and depth in the frame buffer
-	glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	// clear the color and depth in the frame buffer - unless the static layer's blit covers them
+	bool layered = render_mode == RENDER_MESHES && static_layer.Framebuffer != 0;
+	if (!layered)
+		glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 	// use the loaded shader program
 	// Don't change unless you know what you are doing
@@ -737,11 +949,11 @@ void draw ()
 	// Compute Camera matrix (view)
 	// Matrices.view = glm::lookAt( eye, target, up ); // Rotating Camera for 3D
 	//  Don't change unless you are sure!!
-	Matrices.view = glm::lookAt(glm::vec3(eyeview,targetview,upview), glm::vec3(0,0,0), glm::vec3(0,1,0)); // Fixed camera for 2D (ortho) in XY plane
+	// Fixed camera for 2D (ortho) in XY plane, only recomputed when the A/S/Z/O keys change it
 	//Matrix.view=glm::lookAt(0.0, 0.0, 0.0, 0.0, 0.0, -100.0, 0.0, 1.0, 0.0);
 	// Compute ViewProject matrix as view/camera might not be changed for this frame (basic scenario)
 	//  Don't change unless you are sure!!
-	glm::mat4 VP = Matrices.projection * Matrices.view;
+	glm::mat4 VP = camera.viewProjection();
 
 	// Send our transformation to the currently bound shader, in the "MVP" uniform
 	// For each model you render, since the MVP will be different (at least the M part)
@@ -768,60 +980,135 @@ void draw ()
 	*/
 	// Pop matrix to undo transformations till last push matrix instead of recomputing model matrix
 	// glPopMatrix ();
-	int index=0,oindex=0;
-	for(float i=4.5;i>=-4.5;i--)
+	glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &VP[0][0]);
+	if (render_mode == RENDER_PROCEDURAL)
 	{
-		for(float j=4.5;j>=-4.5;j--)
-		{
-			Matrices.model = glm::mat4(1.0f);
-
-			glm::mat4 translateBlock = glm::translate (glm::vec3(i, 0, j));        // glTranslatef
-			//glm::mat4 rotateRectangle = glm::rotate((float)(rectangle_rotation*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-			Matrices.model =translateBlock;
-			MVP = VP * Matrices.model;
-			glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-			// draw3DObject draws the VAO given to it using current MVP matrix
-			if(index%8!=5)
-			{
-				draw3DObject(board[index]);
-
-
-
-				if(index%6==1)
-				{
-					Matrices.model = glm::mat4(1.0f);
+		// One instanced draw, only the person's texel is uploaded when it moves
+		BoxInstance moved = { player.PosX, player.PosY, player.PosZ, BOX_PERSON };
+		updateBoxInstance(procedural_boxes, person_slot, moved);
+		drawProceduralBoxes(procedural_boxes);
+		frame_profiler.countDrawCall();
+		return;
+	}
+	if (render_mode == RENDER_POINTS)
+	{
+		// One point draw, the geometry shader makes the boxes - the person is the last point
+		TilePoint moved = { player.PosX, player.PosY, player.PosZ, TILE_PERSON };
+		updateTilePoint(tile_points, tile_points.Points.size() - 1, moved);
+		drawTilePoints(tile_points);
+		frame_profiler.countDrawCall();
+		return;
+	}
 
-					glm::mat4 translateObstacle = glm::translate (glm::vec3(i, 1,j ));        // glTranslatef
-					//glm::mat4 rotateRectangle = glm::rotate((float)(rectangle_rotation*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-					Matrices.model =translateObstacle;
-					MVP = VP * Matrices.model;
-					glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
+	// The static layer is only rendered again when the camera or the level changed
+	bool render_static = !layered || !static_layer.Valid || static_layer.CameraRevision != camera.revision();
+
+	// Every object is only translated - the last MVP columns are computed in one
+	// batch straight into this frame's region of the dynamic buffer, the shader
+	// puts each object's MVP together from VP and its column. Frames that reuse
+	// the static layer only need the person's
+	scene_positions.set(person_slot, player.PosX, player.PosY, player.PosZ);
+	float* columns = (float*) object_columns.begin();
+	float* rows[4] = { columns, columns + MAX_SCENE_OBJECTS, columns + 2*MAX_SCENE_OBJECTS, columns + 3*MAX_SCENE_OBJECTS };
+	// and the palette of each object, after the four rows
+	GLint* palettes = (GLint*) (columns + 4*MAX_SCENE_OBJECTS);
+	if (render_static)
+	{
+		computeTranslatedColumns(VP, scene_positions, rows);
+		for (size_t k = 0; k < scene_types.size(); k++)
+			palettes[k] = scene_types[k];
+	}
+	else
+	{
+		Translation moved = { player.PosX, player.PosY, player.PosZ };
+		glm::mat4 MVP = modelMVP(VP, moved);
+		for (int r = 0; r < 4; r++)
+			rows[r][person_slot] = MVP[3][r];
+		palettes[person_slot] = scene_types[person_slot];
+	}
+	object_columns.end();
+	glBindBufferRange(GL_UNIFORM_BUFFER, OBJECTS_BINDING, object_columns.name(), object_columns.offset(), object_columns.regionBytes());
 
-					// draw3DObject draws the VAO given to it using current MVP matrix
-					draw3DObject(obstacle[oindex++]);
-				}
-			}
+	// Other GL code may have changed the bindings since the last frame
+	bound_vertex_array = 0;
+	bound_fill_mode = 0;
 
-			index++;
-		}
+	if (!layered)
+	{
+		for (size_t k = 0; k < scene_objects.size(); k++)
+			drawSceneObject(k);
+		object_columns.fence();
+		return;
 	}
-	Matrices.model = glm::mat4(1.0f);
 
-	glm::mat4 translatePerson = glm::translate (glm::vec3(person_posx, person_posy,person_posz ));        // glTranslatef
-	//glm::mat4 rotateRectangle = glm::rotate((float)(rectangle_rotation*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-	Matrices.model =translatePerson;
-	MVP = VP * Matrices.model;
-	glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
+	if (render_static)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, static_layer.Framebuffer);
+		glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		for (size_t k = 0; k < scene_objects.size(); k++)
+			if (k != person_slot)
+				drawSceneObject(k);
+		static_layer.Valid = true;
+		static_layer.CameraRevision = camera.revision();
+	}
+	// The person's pixels this frame - conservative, from its box
+	glm::vec3 person_half(PersonMesh::size(0) / 2, PersonMesh::size(1) / 2, PersonMesh::size(2) / 2);
+	ScreenRect moved = projectBox(VP, glm::vec3(player.PosX, player.PosY, player.PosZ), person_half, static_layer.Width, static_layer.Height);
+	bool retained = default_framebuffer != 0;
+	bool partial = partial_redraw_enabled && retained && static_layer_checked && !render_static;
+	ScreenRect previous = person_rect;
+	person_rect = moved;
+	damage_frames++;
+	if (!partial)
+	{
+		// Errors recorded earlier would hide the first blit's
+		if (!static_layer_checked)
+			while (glGetError() != GL_NO_ERROR)
+				;
+		// Leaves the window bound for drawing
+		blitStaticLayer(static_layer, default_framebuffer, 0, 0, static_layer.Width, static_layer.Height);
+		if (!static_layer_checked)
+			checkStaticLayerBlit();
+		drawSceneObject(person_slot);
+		damaged_pixels += (double) static_layer.Width * static_layer.Height;
+		object_columns.fence();
+		return;
+	}
 
-	// draw3DObject draws the VAO given to it using current MVP matrix
-	draw3DObject(person);
+	// Everything else is still on screen from the last frame: restore the
+	// static layer where the person was and is, then draw it clipped to the
+	// rectangles it touches. Nothing moved, nothing to draw
+	frame_damage.clear();
+	if (moved.X0 != previous.X0 || moved.Y0 != previous.Y0 || moved.X1 != previous.X1 || moved.Y1 != previous.Y1)
+	{
+		frame_damage.add(previous);
+		frame_damage.add(moved);
+	}
+	const vector<ScreenRect>& rects = frame_damage.rectangles();
+	for (size_t i = 0; i < rects.size(); i++)
+		blitStaticLayer(static_layer, default_framebuffer, rects[i].X0, rects[i].Y0, rects[i].X1, rects[i].Y1);
+	glEnable(GL_SCISSOR_TEST);
+	for (size_t i = 0; i < rects.size(); i++)
+	{
+		if (!touches(rects[i], moved))
+			continue;
+		glScissor(rects[i].X0, rects[i].Y0, rects[i].X1 - rects[i].X0, rects[i].Y1 - rects[i].Y0);
+		drawSceneObject(person_slot);
+	}
+	glDisable(GL_SCISSOR_TEST);
+	damaged_pixels += frame_damage.area();
+	object_columns.fence();
+}
 
-	if(person_posy==0)
+/* Advance the game state by one frame - called after the frame is drawn */
+void update ()
+{
+	if(player.PosY==0)
 	{
-		person_posy=1;
-		person_posz=-4.5;
-		person_posx=-4.5;
+		requestRedraw();
+		player.PosY=1;
+		player.PosZ=-4.5;
+		player.PosX=-4.5;
 	}
 
 	// Increment angles
@@ -832,6 +1119,12 @@ void draw ()
 	rectangle_rotation = rectangle_rotation + increments*rectangle_rot_dir*rectangle_rot_status;
 }
 
+/* Executed when the window needs to be drawn again, e.g. after being uncovered */
+void windowRefresh (GLFWwindow* window)
+{
+	requestRedraw();
+}
+
 /* Initialise glfw window, I/O callbacks and the renderer to use */
 /* Nothing to Edit here */
 GLFWwindow* initGLFW (int width, int height)
@@ -839,8 +1132,11 @@ GLFWwindow* initGLFW (int width, int height)
 	GLFWwindow* window; // window desciptor/handle
 
 	glfwSetErrorCallback(error_callback);
-	if (!glfwInit()) {
-		exit(EXIT_FAILURE);
+	{
+		TRACE_SCOPE("glfwInit");
+		if (!glfwInit()) {
+			exit(EXIT_FAILURE);
+		}
 	}
 
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -848,7 +1144,10 @@ GLFWwindow* initGLFW (int width, int height)
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
-	window = glfwCreateWindow(width, height, "Game", NULL, NULL);
+	{
+		TRACE_SCOPE("glfwCreateWindow");
+		window = glfwCreateWindow(width, height, "Game", NULL, NULL);
+	}
 
 	if (!window) {
 		glfwTerminate();
@@ -856,7 +1155,14 @@ GLFWwindow* initGLFW (int width, int height)
 	}
 
 	glfwMakeContextCurrent(window);
-	gladLoadGLLoader((GLADloadproc) glfwGetProcAddress);
+
+	// Time the loader so the minimal and full glad builds can be compared
+	double glad_start = glfwGetTime();
+	{
+		TRACE_SCOPE("gladLoadGLLoader");
+		gladLoadGLLoader((GLADloadproc) glfwGetProcAddress);
+	}
+	cout << "GLAD LOAD: " << (glfwGetTime() - glad_start) * 1000.0 << " ms" << endl;
 	glfwSwapInterval( 1 );
 
 	/* --- register callbacks with GLFW --- */
@@ -867,6 +1173,9 @@ GLFWwindow* initGLFW (int width, int height)
 	glfwSetFramebufferSizeCallback(window, reshapeWindow);
 	glfwSetWindowSizeCallback(window, reshapeWindow);
 
+	/* Register function to handle the window's contents being damaged, e.g. uncovered */
+	glfwSetWindowRefreshCallback(window, windowRefresh);
+
 	/* Register function to handle window close */
 	glfwSetWindowCloseCallback(window, quit);
 
@@ -880,29 +1189,108 @@ GLFWwindow* initGLFW (int width, int height)
 	return window;
 }
 
+/* CPU side startup work - runs on a worker thread while the main thread
+   creates the window and GL context. The meshes need none, they are
+   generated at compile time (mesh.h) */
+struct StartupAssets {
+	future<ShaderSources> shaders;
+};
+
+/* Start shader loading on a worker thread */
+/* Must not make any GL calls - there is no context yet */
+void startStartupTasks (StartupAssets& assets)
+{
+	assets.shaders = async(launch::async, [] {
+		TRACE_THREAD_NAME("worker: shaders");
+		TRACE_SCOPE("readShaderSources");
+		const char* geometry = render_mode == RENDER_POINTS ? "Tiles.geom" : NULL;
+		return readShaderSources("Sample_GL.vert", "Sample_GL.frag", render_mode_defines[render_mode], geometry);
+	});
+}
+
 /* Initialize the OpenGL rendering properties */
 /* Add all the models to be created here */
-void initGL (GLFWwindow* window, int width, int height)
+void initGL (GLFWwindow* window, int width, int height, StartupAssets& assets)
 {
-	/* Objects should be created before any other gl function and shaders */
-	// Create the models
-	//createTriangle (); // Generate the VAO, VBOs, vertices data & copy into the array buffer
-	for(int i=0;i<100;i++)
+	TRACE_SCOPE("initGL");
+
+	// Create and compile our GLSL program from the shaders
+	// Compilation is only submitted here, the driver can work on it while the meshes are uploaded
+	PendingProgram pending;
 	{
-		board[i]=createBoard (1,1,1,0,0,0);
+		TRACE_SCOPE("compileShaders");
+		pending = compileShaders(assets.shaders.get());
 	}
 
-	for(int i=0;i<30;i++)
+	// Create the models while the shaders compile - all uploads happen here in one batch, straight from the compile time mesh data
+	//createTriangle (); // Generate the VAO, VBOs, vertices data & copy into the array buffer
+	if (render_mode == RENDER_MESHES)
 	{
-		obstacle[i]=createObstacle(0.8,1,0.8,0.4,0.2,0);
-	}	
-
+		TRACE_SCOPE("upload meshes");
+		createLevelObjects();
+	}
+	buildScene();
+	if (render_mode == RENDER_PROCEDURAL)
+	{
+		TRACE_SCOPE("upload instances");
+		vector<BoxInstance> instances;
+		for (size_t k = 0; k < scene_types.size(); k++)
+		{
+			BoxInstance instance = { scene_positions.X[k], scene_positions.Y[k], scene_positions.Z[k], (GLfloat) scene_types[k] };
+			instances.push_back(instance);
+		}
+		createProceduralBoxes(procedural_boxes, instances);
+		resources.add(ResourceRegistry::VERTEX_ARRAY, procedural_boxes.VertexArray, 0, "procedural boxes");
+		resources.add(ResourceRegistry::BUFFER, procedural_boxes.InstanceBuffer, instances.size() * sizeof(BoxInstance), "box instances");
+		resources.add(ResourceRegistry::TEXTURE, procedural_boxes.InstanceTexture, 0, "box instances");
+	}
+	if (render_mode == RENDER_POINTS)
+	{
+		TRACE_SCOPE("upload tile points");
+		createTilePoints(tile_points, scene_tiles);
+		resources.add(ResourceRegistry::VERTEX_ARRAY, tile_points.VertexArray, 0, "tile points");
+		resources.add(ResourceRegistry::BUFFER, tile_points.PointBuffer, scene_tiles.size() * sizeof(TilePoint), "tile points");
+	}
 
-	person=createPerson(0.4,1,0.4,1,0,0.5);
-	// Create and compile our GLSL program from the shaders
-	programID = LoadShaders( "Sample_GL.vert", "Sample_GL.frag" );
-	// Get a handle for our "MVP" uniform
-	Matrices.MatrixID = glGetUniformLocation(programID, "MVP");
+	{
+		TRACE_SCOPE("linkShaders");
+		programID = linkShaders(pending);
+	}
+	// Get a handle for our "VP" uniform
+	Matrices.MatrixID = glGetUniformLocation(programID, "VP");
+	if (render_mode != RENDER_MESHES)
+	{
+		glUseProgram(programID);
+		setBoxPalette(programID);
+	}
+	else
+	{
+		Matrices.ObjectID = glGetUniformLocation(programID, "Object");
+		glUniformBlockBinding(programID, glGetUniformBlockIndex(programID, "Objects"), OBJECTS_BINDING);
+
+		// Captures only see what goes through GL calls, so they get the copying path
+		GLint alignment;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		DynamicBuffer::Mode mode = buffer_storage ? DynamicBuffer::bestMode() : DynamicBuffer::MAP_RANGE;
+		if (glHookState().Capturing)
+			mode = DynamicBuffer::COPY;
+		object_columns.create(GL_UNIFORM_BUFFER, 4 * MAX_SCENE_OBJECTS * sizeof(GLfloat) + MAX_SCENE_OBJECTS * sizeof(GLint), alignment, mode);
+		resources.add(ResourceRegistry::BUFFER, object_columns.name(), object_columns.totalBytes(), "object columns");
+
+		// The palettes never change: six vec4 face colours per box type, the
+		// block's full size so the binding covers all of it
+		vector<GLfloat> sizes, colors;
+		boxPalette(sizes, colors);
+		vector<GLfloat> palette(4 * 6 * MAX_PALETTES, 0);
+		for (size_t i = 0; i < colors.size() / 3; i++)
+			copy(&colors[3*i], &colors[3*i] + 3, &palette[4*i]);
+		glGenBuffers(1, &palette_buffer);
+		glBindBuffer(GL_UNIFORM_BUFFER, palette_buffer);
+		glBufferData(GL_UNIFORM_BUFFER, palette.size() * sizeof(GLfloat), &palette[0], GL_STATIC_DRAW);
+		glBindBufferRange(GL_UNIFORM_BUFFER, PALETTE_BINDING, palette_buffer, 0, palette.size() * sizeof(GLfloat));
+		glUniformBlockBinding(programID, glGetUniformBlockIndex(programID, "Palette"), PALETTE_BINDING);
+		resources.add(ResourceRegistry::BUFFER, palette_buffer, palette.size() * sizeof(GLfloat), "palette");
+	}
 
 
 	reshapeWindow (window, width, height);
@@ -918,6 +1306,57 @@ void initGL (GLFWwindow* window, int width, int height)
 	cout << "RENDERER: " << glGetString(GL_RENDERER) << endl;
 	cout << "VERSION: " << glGetString(GL_VERSION) << endl;
 	cout << "GLSL: " << glGetString(GL_SHADING_LANGUAGE_VERSION) << endl;
+	cout << "RENDER: " << render_mode_names[render_mode] << endl;
+	if (render_mode == RENDER_MESHES) {
+		cout << "DYNAMIC BUFFERS: " << DynamicBuffer::modeName(object_columns.currentMode()) << endl;
+		cout << "MESHES: " << mesh_cache.size() << " uploaded for " << mesh_cache.lookupCount() << " objects ("
+			<< mesh_arena.usedVertices() << " vertices)" << endl;
+		cout << "BOARD MESH: " << board_triangles << " triangles" << endl;
+	}
+}
+
+/* Benchmark mode (--bench <seconds>): vsync off and a fixed input script,
+   one key every BENCH_STEP seconds. The moves only use safe tiles so the
+   run never ends early, and the zoom is reset each time the script loops */
+const double BENCH_STEP = 0.25;
+const int bench_script[] = {
+	GLFW_KEY_S, GLFW_KEY_RIGHT, GLFW_KEY_LEFT, GLFW_KEY_UP, GLFW_KEY_DOWN,
+	GLFW_KEY_Z, GLFW_KEY_Z, GLFW_KEY_Z, GLFW_KEY_Z,
+	GLFW_KEY_A, GLFW_KEY_RIGHT, GLFW_KEY_LEFT, GLFW_KEY_SPACE, GLFW_KEY_RIGHT,
+	GLFW_KEY_O, GLFW_KEY_O, GLFW_KEY_S,
+};
+const int BENCH_SCRIPT_LENGTH = sizeof(bench_script) / sizeof(bench_script[0]);
+
+/* Play every script step that is due at 'elapsed' seconds into the run */
+void benchStep (GLFWwindow* window, double elapsed)
+{
+	static int next_step = 0;
+	while (next_step * BENCH_STEP <= elapsed) {
+		if (next_step % BENCH_SCRIPT_LENGTH == 0) {
+			camera.setZoom(Camera::DEFAULT_ZOOM);
+		}
+		keyboard(window, bench_script[next_step % BENCH_SCRIPT_LENGTH], 0, GLFW_PRESS, 0);
+		next_step++;
+	}
+}
+
+/* Print the benchmark result as a single line of JSON */
+void printBenchResult (double seconds)
+{
+	FrameProfiler::Stats stats = frame_profiler.totals();
+	// Frames that reuse cached pixels do less than a full frame, say so
+	bool cached = static_layer.Framebuffer != 0;
+	bool partial = cached && partial_redraw_enabled && default_framebuffer != 0;
+	printf("{\"benchmark\": \"game2\", \"renderer\": \"%s\", \"render\": \"%s\", "
+			"\"static_layer\": %s, \"partial_redraw\": %s, \"seconds\": %.3f, \"frames\": %d, \"fps\": %.2f, "
+			"\"frame_ms\": {\"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f}, "
+			"\"gpu_ms\": {\"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f}, "
+			"\"draw_calls_per_frame\": %.1f}\n",
+			(const char*) glGetString(GL_RENDERER), render_mode_names[render_mode],
+			cached ? "true" : "false", partial ? "true" : "false", seconds, stats.Frames, stats.Frames / seconds,
+			stats.Frame[0], stats.Frame[1], stats.Frame[2],
+			stats.Gpu[0], stats.Gpu[1], stats.Gpu[2],
+			stats.DrawCallsAvg);
 }
 
 int main (int argc, char** argv)
@@ -925,42 +1364,247 @@ int main (int argc, char** argv)
 	int width = 600;
 	int height = 600;
 
-	GLFWwindow* window = initGLFW(width, height);
+	chrono::steady_clock::time_point startup_time = chrono::steady_clock::now();
+	bool first_frame = true;
+
+	bool profile = false;
+	double bench_seconds = 0;
+	bool headless = false;
+	int max_frames = 0;
+#ifdef ENABLE_HEADLESS
+	const char* dump_prefix = NULL;
+#endif
+	bool gl_time = false;
+	const char* gl_capture = NULL;
+	int gl_capture_frames = 1;
+	for (int i = 1; i < argc; i++) {
+		if (string(argv[i]) == "--profile")
+			profile = true;
+		else if (string(argv[i]) == "--bench" && i + 1 < argc)
+			bench_seconds = atof(argv[++i]);
+		else if (string(argv[i]) == "--headless")
+			headless = true;
+		else if (string(argv[i]) == "--frames" && i + 1 < argc)
+			max_frames = atoi(argv[++i]);
+		else if (string(argv[i]) == "--dump" && i + 1 < argc) {
+#ifdef ENABLE_HEADLESS
+			dump_prefix = argv[++i];
+#else
+			cerr << "built without the headless backend, --dump needs 'make HEADLESS=1'" << endl;
+			exit(EXIT_FAILURE);
+#endif
+		}
+		else if (string(argv[i]) == "--resources")
+			resource_report = true;
+		else if (string(argv[i]) == "--gl-stats")
+			gl_stats = true;
+		else if (string(argv[i]) == "--gl-time")
+			gl_stats = gl_time = true;
+		else if (string(argv[i]) == "--gl-capture" && i + 1 < argc)
+			gl_capture = argv[++i];
+		else if (string(argv[i]) == "--gl-capture-frames" && i + 1 < argc)
+			gl_capture_frames = atoi(argv[++i]);
+		else if (string(argv[i]) == "--no-buffer-storage")
+			buffer_storage = false;
+		else if (string(argv[i]) == "--no-static-layer")
+			static_layer_enabled = false;
+		else if (string(argv[i]) == "--no-partial-redraw")
+			partial_redraw_enabled = false;
+		else if (string(argv[i]) == "--on-demand")
+			on_demand = true;
+		else if (string(argv[i]) == "--render" && i + 1 < argc) {
+			string mode = argv[++i];
+			int m = 0;
+			while (m < NUM_RENDER_MODES && mode != render_mode_names[m])
+				m++;
+			if (m == NUM_RENDER_MODES) {
+				cerr << "unknown render mode " << mode << endl;
+				exit(EXIT_FAILURE);
+			}
+			render_mode = (RenderMode) m;
+		}
+	}
+#ifndef ENABLE_HEADLESS
+	if (headless) {
+		cerr << "built without the headless backend, rebuild with 'make HEADLESS=1'" << endl;
+		exit(EXIT_FAILURE);
+	}
+#else
+	// Frames are only read back from the headless framebuffer
+	if (dump_prefix != NULL && !headless) {
+		cerr << "--dump needs --headless" << endl;
+		exit(EXIT_FAILURE);
+	}
+#endif
+	// Without a window nothing can close the game, stop after one frame by default
+	if (headless && max_frames == 0 && bench_seconds <= 0)
+		max_frames = 1;
+	// No events to wait for without a window, and the benchmark draws flat out
+	if (on_demand && (headless || bench_seconds > 0)) {
+		cerr << "--on-demand needs a window and no --bench, drawing every frame" << endl;
+		on_demand = false;
+	}
+
+	TRACE_THREAD_NAME("main");
+
+	StartupAssets assets;
+	startStartupTasks (assets);
+
+	GLFWwindow* window = NULL;
+#ifdef ENABLE_HEADLESS
+	HeadlessContext headless_context;
+	if (headless) {
+		TRACE_SCOPE("initHeadless");
+		if (!initHeadless(headless_context, width, height))
+			exit(EXIT_FAILURE);
+		default_framebuffer = headless_context.Framebuffer;
+		resources.add(ResourceRegistry::FRAMEBUFFER, headless_context.Framebuffer, 0, "headless");
+		resources.add(ResourceRegistry::RENDERBUFFER, headless_context.ColorBuffer, 4 * width * height, "headless color");
+		resources.add(ResourceRegistry::RENDERBUFFER, headless_context.DepthBuffer, 4 * width * height, "headless depth");
+	}
+	else
+#endif
+	{
+		TRACE_SCOPE("initGLFW");
+		window = initGLFW(width, height);
+	}
 
-	initGL (window, width, height);
+	// Wrap glad's function pointers to count (and time or record) every GL call
+	bool gl_hooks = gl_stats || gl_capture != NULL;
+	if (gl_hooks)
+		installGLHooks(gl_time);
+	if (gl_capture != NULL)
+		captureGLFrames(gl_capture, gl_capture_frames, width, height);
+
+	initGL (window, width, height, assets);
+	if (resource_report)
+		resources.print();
+
+	if (profile || bench_seconds > 0) {
+		frame_profiler.init();
+		for (int i = 0; i < FrameProfiler::queryCount(); i++)
+			resources.add(ResourceRegistry::QUERY, frame_profiler.query(i), 0, "gpu timer");
+	}
+	if (bench_seconds > 0 && window != NULL)
+		glfwSwapInterval( 0 ); // measure rendering throughput, not the display refresh
 
-	double last_update_time = glfwGetTime(), current_time;
+	double last_update_time = getTime(), current_time;
+	double last_report_time = last_update_time;
+	double bench_start = last_update_time;
+	int frame_count = 0;
+	on_demand_start = last_update_time;
 
 	/* Draw in loop */
-	while (!glfwWindowShouldClose(window)) {
+	while (window != NULL ? !glfwWindowShouldClose(window) : (max_frames == 0 || frame_count < max_frames)) {
+
+		frame_profiler.beginFrame();
+		if (gl_hooks)
+			beginGLHookFrame();
 
 		// OpenGL Draw commands
-		draw();
-		reshapeWindow ( window , width , height );
+		{
+			TRACE_SCOPE("draw");
+			ProfileSection section(frame_profiler, FrameProfiler::DRAW);
+			frame_profiler.beginGpu();
+			draw();
+			frame_profiler.endGpu();
+			// Free what was removed in earlier frames and the GPU is done with
+			deferred_deletes.endFrame();
+			deferred_deletes.collect();
+		}
+		{
+			ProfileSection section(frame_profiler, FrameProfiler::SIMULATION);
+			update();
+			camera.update(getTime());
+			// An animated zoom needs the next frame too
+			if (camera.isAnimating())
+				requestRedraw();
+		}
 		// Swap Frame Buffer in double buffering
-		glfwSwapBuffers(window);
+		{
+			TRACE_SCOPE("glfwSwapBuffers");
+			ProfileSection section(frame_profiler, FrameProfiler::SWAP);
+			if (window != NULL)
+				glfwSwapBuffers(window);
+			else
+				glFlush();
+		}
+#ifdef ENABLE_HEADLESS
+		if (headless && dump_prefix != NULL) {
+			char path[512];
+			snprintf(path, sizeof(path), "%s%04d.ppm", dump_prefix, frame_count);
+			dumpHeadlessFrame(headless_context, path);
+		}
+#endif
+		frame_count++;
+		on_demand_frames++;
+		if (gl_hooks)
+			endGLHookFrame();
+
+		if (first_frame) {
+			first_frame = false;
+			cout << "TIME TO FIRST FRAME: " << chrono::duration<double, milli>(chrono::steady_clock::now() - startup_time).count() << " ms" << endl;
+			// Startup is over once the first frame is on screen
+			TRACE_WRITE("startup_trace.json");
+		}
 
-		// Poll for Keyboard and mouse events
-		glfwPollEvents();
+		// Poll for Keyboard and mouse events - or sleep until one needs a frame
+		{
+			ProfileSection section(frame_profiler, FrameProfiler::POLL);
+			if (on_demand && frame_profiler.isEnabled())
+				scheduleRedraw(last_report_time + PROFILE_REPORT_INTERVAL);
+			if (window != NULL && on_demand)
+				waitForRedraw(window);
+			else if (window != NULL)
+				glfwPollEvents();
+		}
+		frame_profiler.endFrame();
 
 		// Control based on time (Time based transformation like 5 degrees rotation every 0.5s)
-		current_time = glfwGetTime(); // Time in seconds
+		current_time = getTime(); // Time in seconds
 		if ((current_time - last_update_time) >= 1) { // atleast 0.5s elapsed since last frame
 			// do something every 0.5 seconds ..
 			last_update_time = current_time;
 		}
-		if(lives==0)
+		if (bench_seconds > 0) {
+			if (current_time - bench_start >= bench_seconds) {
+				printBenchResult(current_time - bench_start);
+				break;
+			}
+			benchStep(window, current_time - bench_start);
+		}
+		else if (frame_profiler.isEnabled() && (current_time - last_report_time) >= PROFILE_REPORT_INTERVAL) {
+			FrameProfiler::print("frame profile", frame_profiler.takeWindow());
+			if (on_demand)
+				printIdle();
+			last_report_time = current_time;
+		}
+		if(player.Lives==0)
 		{
 			cout<<"LOST THE GAME"<<endl;
 			break;
 		}
-		if(block_pos==0)
+		if(player.BlockPos==0)
 		{
 			cout<<"YOU WON THE GAME"<<endl;
 			break;
 		}
 	}
 
+	if (bench_seconds <= 0)
+		reportProfile();
+#ifdef ENABLE_HEADLESS
+	if (headless) {
+		resources.remove(ResourceRegistry::FRAMEBUFFER, headless_context.Framebuffer);
+		resources.remove(ResourceRegistry::RENDERBUFFER, headless_context.ColorBuffer);
+		resources.remove(ResourceRegistry::RENDERBUFFER, headless_context.DepthBuffer);
+	}
+#endif
+	releaseResources();
+#ifdef ENABLE_HEADLESS
+	if (headless)
+		destroyHeadless(headless_context);
+#endif
 	glfwTerminate();
 	exit(EXIT_SUCCESS);
 }
@@ -143,11 +143,94 @@ static const char *exts = NULL;
 static int num_exts_i = 0;
 static const char **exts_i = NULL;
 
+/* Open-addressing hash set of the reported extension names, built once by
+ * get_exts() so that every has_ext() query is a single probe sequence instead
+ * of a scan over all reported extensions. Names point into exts/exts_i. */
+struct ext_entry {
+    const char *name;
+    size_t len;
+    unsigned int hash;
+};
+
+static struct ext_entry *ext_set = NULL;
+static unsigned int ext_set_mask = 0;
+
+static unsigned int hash_ext(const char *name, size_t len) {
+    /* FNV-1a */
+    unsigned int hash = 2166136261u;
+    size_t index;
+
+    for(index = 0; index < len; index++) {
+        hash ^= (unsigned char)name[index];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static int alloc_ext_set(int count) {
+    unsigned int size = 16;
+
+    while(size < (unsigned int)count * 2) {
+        size <<= 1;
+    }
+
+    free(ext_set);
+    ext_set = (struct ext_entry *)calloc(size, sizeof *ext_set);
+    if(ext_set == NULL) {
+        return 0;
+    }
+
+    ext_set_mask = size - 1;
+    return 1;
+}
+
+static void insert_ext(const char *name, size_t len) {
+    unsigned int hash = hash_ext(name, len);
+    unsigned int slot = hash & ext_set_mask;
+
+    while(ext_set[slot].name != NULL) {
+        if(ext_set[slot].hash == hash && ext_set[slot].len == len &&
+            strncmp(ext_set[slot].name, name, len) == 0) {
+            return;
+        }
+        slot = (slot + 1) & ext_set_mask;
+    }
+
+    ext_set[slot].name = name;
+    ext_set[slot].len = len;
+    ext_set[slot].hash = hash;
+}
+
 static int get_exts(void) {
 #ifdef _GLAD_IS_SOME_NEW_VERSION
     if(max_loaded_major < 3) {
 #endif
+        const char *loc;
+        int count = 0;
+
         exts = (const char *)glGetString(GL_EXTENSIONS);
+
+        /* the legacy string is space separated, count the names first */
+        for(loc = exts; loc != NULL && *loc != '\0'; loc++) {
+            if(*loc != ' ' && (loc == exts || *(loc - 1) == ' ')) {
+                count++;
+            }
+        }
+
+        if (!alloc_ext_set(count)) {
+            return 0;
+        }
+
+        for(loc = exts; loc != NULL && *loc != '\0'; ) {
+            size_t len = strcspn(loc, " ");
+
+            if(len > 0) {
+                insert_ext(loc, len);
+            }
+            loc += len;
+            loc += strspn(loc, " ");
+        }
 #ifdef _GLAD_IS_SOME_NEW_VERSION
     } else {
         int index;
@@ -162,8 +245,15 @@ static int get_exts(void) {
             return 0;
         }
 
+        if (!alloc_ext_set(num_exts_i)) {
+            return 0;
+        }
+
         for(index = 0; index < num_exts_i; index++) {
             exts_i[index] = (const char*)glGetStringi(GL_EXTENSIONS, index);
+            if(exts_i[index] != NULL) {
+                insert_ext(exts_i[index], strlen(exts_i[index]));
+            }
         }
     }
 #endif
@@ -175,46 +265,33 @@ static void free_exts(void) {
         free(exts_i);
         exts_i = NULL;
     }
+    if (ext_set != NULL) {
+        free(ext_set);
+        ext_set = NULL;
+        ext_set_mask = 0;
+    }
 }
 
 static int has_ext(const char *ext) {
-#ifdef _GLAD_IS_SOME_NEW_VERSION
-    if(max_loaded_major < 3) {
-#endif
-        const char *extensions;
-        const char *loc;
-        const char *terminator;
-        extensions = exts;
-        if(extensions == NULL || ext == NULL) {
-            return 0;
-        }
+    size_t len;
+    unsigned int hash;
+    unsigned int slot;
 
-        while(1) {
-            loc = strstr(extensions, ext);
-            if(loc == NULL) {
-                return 0;
-            }
-
-            terminator = loc + strlen(ext);
-            if((loc == extensions || *(loc - 1) == ' ') &&
-                (*terminator == ' ' || *terminator == '\0')) {
-                return 1;
-            }
-            extensions = terminator;
-        }
-#ifdef _GLAD_IS_SOME_NEW_VERSION
-    } else {
-        int index;
+    if(ext_set == NULL || ext == NULL) {
+        return 0;
+    }
 
-        for(index = 0; index < num_exts_i; index++) {
-            const char *e = exts_i[index];
+    len = strlen(ext);
+    hash = hash_ext(ext, len);
+    slot = hash & ext_set_mask;
 
-            if(strcmp(e, ext) == 0) {
-                return 1;
-            }
+    while(ext_set[slot].name != NULL) {
+        if(ext_set[slot].hash == hash && ext_set[slot].len == len &&
+            strncmp(ext_set[slot].name, ext, len) == 0) {
+            return 1;
         }
+        slot = (slot + 1) & ext_set_mask;
     }
-#endif
 
     return 0;
 }
@@ -3280,6 +3357,9 @@ PFNGLREPLACEMENTCODEUITEXCOORD2FNORMAL3FVERTEX3FSUNPROC glad_glReplacementCodeui
 PFNGLREPLACEMENTCODEUITEXCOORD2FNORMAL3FVERTEX3FVSUNPROC glad_glReplacementCodeuiTexCoord2fNormal3fVertex3fvSUN;
 PFNGLREPLACEMENTCODEUITEXCOORD2FCOLOR4FNORMAL3FVERTEX3FSUNPROC glad_glReplacementCodeuiTexCoord2fColor4fNormal3fVertex3fSUN;
 PFNGLREPLACEMENTCODEUITEXCOORD2FCOLOR4FNORMAL3FVERTEX3FVSUNPROC glad_glReplacementCodeuiTexCoord2fColor4fNormal3fVertex3fvSUN;
+#ifndef GLAD_MINIMAL
+/* The stock loaders, one per GL version and extension - the minimal build
+ * resolves glad_used.inc instead (load_GL_minimal) */
 static void load_GL_VERSION_1_0(GLADloadproc load) {
 	if(!GLAD_GL_VERSION_1_0) return;
 	glad_glCullFace = (PFNGLCULLFACEPROC)load("glCullFace");
@@ -6895,6 +6975,7 @@ static void load_GL_SUN_vertex(GLADloadproc load) {
 	glad_glReplacementCodeuiTexCoord2fColor4fNormal3fVertex3fSUN = (PFNGLREPLACEMENTCODEUITEXCOORD2FCOLOR4FNORMAL3FVERTEX3FSUNPROC)load("glReplacementCodeuiTexCoord2fColor4fNormal3fVertex3fSUN");
 	glad_glReplacementCodeuiTexCoord2fColor4fNormal3fVertex3fvSUN = (PFNGLREPLACEMENTCODEUITEXCOORD2FCOLOR4FNORMAL3FVERTEX3FVSUNPROC)load("glReplacementCodeuiTexCoord2fColor4fNormal3fVertex3fvSUN");
 }
+#endif /* GLAD_MINIMAL */
 static int find_extensionsGL(void) {
 	if (!get_exts()) return 0;
 	GLAD_GL_3DFX_multisample = has_ext("GL_3DFX_multisample");
@@ -7496,12 +7577,32 @@ static void find_coreGL(void) {
 	}
 }
 
+#ifdef GLAD_MINIMAL
+/* Resolve only the entry points the application references instead of the
+ * whole 3.3 core plus every vendor extension. glad_used.inc holds one
+ * GLAD_USE(name) line per referenced function and is generated by the
+ * Makefile from the application sources. */
+static void load_GL_minimal(GLADloadproc load) {
+	/* needed by find_extensionsGL itself */
+	glGetIntegerv = (PFNGLGETINTEGERVPROC)load("glGetIntegerv");
+	glGetStringi = (PFNGLGETSTRINGIPROC)load("glGetStringi");
+#define GLAD_USE(name) *(void **)(&glad_##name) = load(#name);
+#include "glad_used.inc"
+#undef GLAD_USE
+}
+#endif
+
 int gladLoadGLLoader(GLADloadproc load) {
 	GLVersion.major = 0; GLVersion.minor = 0;
 	glGetString = (PFNGLGETSTRINGPROC)load("glGetString");
 	if(glGetString == NULL) return 0;
 	if(glGetString(GL_VERSION) == NULL) return 0;
 	find_coreGL();
+#ifdef GLAD_MINIMAL
+	load_GL_minimal(load);
+	if (!find_extensionsGL()) return 0;
+	return GLVersion.major != 0 || GLVersion.minor != 0;
+#else
 	load_GL_VERSION_1_0(load);
 	load_GL_VERSION_1_1(load);
 	load_GL_VERSION_1_2(load);
@@ -7789,5 +7890,6 @@ int gladLoadGLLoader(GLADloadproc load) {
 	load_GL_SUN_triangle_list(load);
 	load_GL_SUN_vertex(load);
 	return GLVersion.major != 0 || GLVersion.minor != 0;
+#endif
 }
 
@@ -0,0 +1,392 @@
+#ifndef GLHOOK_H
+#define GLHOOK_H
+
+/*
+ * GL call interception on top of glad's function pointers.
+ *
+ * installGLHooks() swaps every glad_glXxx pointer listed in glad_used.inc
+ * (the functions the game references, generated by the Makefile) for a
+ * wrapper that counts the call, optionally times it, and can append it to a
+ * binary call stream before forwarding to the driver. Nothing is wrapped
+ * until installGLHooks() is called, so the cost is zero when unused.
+ *
+ * Call stream format (native endianness), replayed by ./replay:
+ *   "GLCS" magic, uint32 version, uint32 width, uint32 height,
+ *   uint32 function count, per function: uint16 name length + name
+ *   per call: uint16 function id, uint16 argument bytes, uint32 CPU ns,
+ *             uint32 data bytes, the raw argument values (pointers as
+ *             addresses), then the data - memory the call reads (buffer
+ *             contents, shader sources, matrices, object names to delete),
+ *             the return value and memory it writes (generated names)
+ *   frame boundaries: a call with id GL_FRAME_MARKER and no arguments
+ *             before each frame and after the last one
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+enum GLHookID {
+#define GLAD_USE(name) HOOK_##name,
+#include "glad_used.inc"
+#undef GLAD_USE
+	GL_HOOK_COUNT
+};
+
+static const char* gl_hook_names[] = {
+#define GLAD_USE(name) #name,
+#include "glad_used.inc"
+#undef GLAD_USE
+	""
+};
+
+const unsigned int GL_CALL_STREAM_VERSION = 2;
+const unsigned short GL_FRAME_MARKER = 0xffff;
+const size_t GL_CALL_HEADER_BYTES = 12;
+
+struct GLHookState {
+	bool Timing;
+	bool Capturing;
+	unsigned long long FrameCalls[GL_HOOK_COUNT];
+	unsigned long long TotalCalls[GL_HOOK_COUNT];
+	double TotalNanoseconds[GL_HOOK_COUNT];
+	int Frames;
+	std::vector<char> Stream;
+	const char* CapturePath;
+	int CaptureFrames;	// frames to capture in total
+	int CapturedFrames;
+	unsigned int CaptureWidth;
+	unsigned int CaptureHeight;
+};
+
+inline GLHookState& glHookState ()
+{
+	static GLHookState state;
+	return state;
+}
+
+template <typename T>
+inline void appendBytes (std::vector<char>& out, const T& value)
+{
+	const char* bytes = (const char*) &value;
+	out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+inline void appendData (std::vector<char>& out, const void* data, size_t size)
+{
+	const char* bytes = (const char*) data;
+	out.insert(out.end(), bytes, bytes + size);
+}
+
+/* Counts, times and records one intercepted call */
+class GLCallScope {
+public:
+	template <typename... A>
+	GLCallScope (int id, A... args) : id(id), recording(false), record(0), arg_bytes(0), ns(0)
+	{
+		GLHookState& state = glHookState();
+		state.FrameCalls[id]++;
+		if (state.Capturing) {
+			recording = true;
+			record = state.Stream.size();
+			appendBytes(state.Stream, (unsigned short) id);
+			appendBytes(state.Stream, (unsigned short) 0);
+			appendBytes(state.Stream, (unsigned int) 0);
+			appendBytes(state.Stream, (unsigned int) 0);
+			int expand[] = { 0, (appendBytes(state.Stream, args), 0)... };
+			(void) expand;
+			arg_bytes = (unsigned short) (state.Stream.size() - record - GL_CALL_HEADER_BYTES);
+			memcpy(&state.Stream[record + 2], &arg_bytes, sizeof(arg_bytes));
+		}
+	}
+
+	~GLCallScope ()
+	{
+		if (!recording)
+			return;
+		GLHookState& state = glHookState();
+		unsigned int data_bytes = (unsigned int) (state.Stream.size() - record - GL_CALL_HEADER_BYTES - arg_bytes);
+		memcpy(&state.Stream[record + 8], &data_bytes, sizeof(data_bytes));
+		if (state.Timing) {
+			unsigned int cpu_ns = (unsigned int) std::min(ns, 4294967295.0);
+			memcpy(&state.Stream[record + 4], &cpu_ns, sizeof(cpu_ns));
+		}
+	}
+
+	bool isRecording () const { return recording; }
+
+	/* Data section of the record being written */
+	std::vector<char>& data () { return glHookState().Stream; }
+
+	void start ()
+	{
+		if (glHookState().Timing)
+			begin = std::chrono::steady_clock::now();
+	}
+
+	void stop ()
+	{
+		GLHookState& state = glHookState();
+		if (!state.Timing)
+			return;
+		ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+		state.TotalNanoseconds[id] += ns;
+	}
+
+private:
+	int id;
+	bool recording;
+	size_t record;
+	unsigned short arg_bytes;
+	double ns;
+	std::chrono::steady_clock::time_point begin;
+};
+
+/*
+ * What a call reads from or writes to memory, for the functions that take
+ * pointers. input() runs before the call, output() after it.
+ */
+struct GLCaptureNothing {
+	template <typename... A> static void input (std::vector<char>&, A...) {}
+	template <typename... A> static void output (std::vector<char>&, A...) {}
+};
+
+template <int ID> struct GLCapture : GLCaptureNothing {};
+
+struct GLCaptureGen : GLCaptureNothing {
+	static void output (std::vector<char>& out, GLsizei n, GLuint* names) { appendData(out, names, n * sizeof(GLuint)); }
+};
+
+struct GLCaptureDelete : GLCaptureNothing {
+	static void input (std::vector<char>& out, GLsizei n, const GLuint* names) { appendData(out, names, n * sizeof(GLuint)); }
+};
+
+template <> struct GLCapture<HOOK_glGenBuffers> : GLCaptureGen {};
+template <> struct GLCapture<HOOK_glGenVertexArrays> : GLCaptureGen {};
+template <> struct GLCapture<HOOK_glGenQueries> : GLCaptureGen {};
+template <> struct GLCapture<HOOK_glGenFramebuffers> : GLCaptureGen {};
+template <> struct GLCapture<HOOK_glGenRenderbuffers> : GLCaptureGen {};
+template <> struct GLCapture<HOOK_glGenTextures> : GLCaptureGen {};
+template <> struct GLCapture<HOOK_glDeleteFramebuffers> : GLCaptureDelete {};
+template <> struct GLCapture<HOOK_glDeleteRenderbuffers> : GLCaptureDelete {};
+template <> struct GLCapture<HOOK_glDeleteBuffers> : GLCaptureDelete {};
+template <> struct GLCapture<HOOK_glDeleteVertexArrays> : GLCaptureDelete {};
+template <> struct GLCapture<HOOK_glDeleteTextures> : GLCaptureDelete {};
+template <> struct GLCapture<HOOK_glDeleteQueries> : GLCaptureDelete {};
+
+template <> struct GLCapture<HOOK_glBufferData> : GLCaptureNothing {
+	static void input (std::vector<char>& out, GLenum, GLsizeiptr size, const void* data, GLenum)
+	{
+		if (data != NULL)
+			appendData(out, data, size);
+	}
+};
+
+template <> struct GLCapture<HOOK_glBufferSubData> : GLCaptureNothing {
+	static void input (std::vector<char>& out, GLenum, GLintptr, GLsizeiptr size, const void* data) { appendData(out, data, size); }
+};
+
+/* Each string as uint32 length + characters */
+template <> struct GLCapture<HOOK_glShaderSource> : GLCaptureNothing {
+	static void input (std::vector<char>& out, GLuint, GLsizei count, const GLchar* const* strings, const GLint* lengths)
+	{
+		for (int i = 0; i < count; i++) {
+			unsigned int length = (lengths != NULL && lengths[i] >= 0) ? lengths[i] : strlen(strings[i]);
+			appendBytes(out, length);
+			appendData(out, strings[i], length);
+		}
+	}
+};
+
+template <> struct GLCapture<HOOK_glGetUniformLocation> : GLCaptureNothing {
+	static void input (std::vector<char>& out, GLuint, const GLchar* name) { appendData(out, name, strlen(name) + 1); }
+};
+
+template <> struct GLCapture<HOOK_glGetUniformBlockIndex> : GLCaptureNothing {
+	static void input (std::vector<char>& out, GLuint, const GLchar* name) { appendData(out, name, strlen(name) + 1); }
+};
+
+template <> struct GLCapture<HOOK_glUniform3fv> : GLCaptureNothing {
+	static void input (std::vector<char>& out, GLint, GLsizei count, const GLfloat* value) { appendData(out, value, count * 3 * sizeof(GLfloat)); }
+};
+
+template <> struct GLCapture<HOOK_glUniformMatrix4fv> : GLCaptureNothing {
+	static void input (std::vector<char>& out, GLint, GLsizei count, GLboolean, const GLfloat* value)
+	{
+		appendData(out, value, count * 16 * sizeof(GLfloat));
+	}
+};
+
+/* Forwards to the driver, recording the return value if there is one */
+template <typename R>
+struct GLForward {
+	template <typename Capture, typename F, typename... A>
+	static R call (GLCallScope& scope, F real, A... args)
+	{
+		if (scope.isRecording())
+			Capture::input(scope.data(), args...);
+		scope.start();
+		R result = real(args...);
+		scope.stop();
+		if (scope.isRecording()) {
+			appendBytes(scope.data(), result);
+			Capture::output(scope.data(), args...);
+		}
+		return result;
+	}
+};
+
+template <>
+struct GLForward<void> {
+	template <typename Capture, typename F, typename... A>
+	static void call (GLCallScope& scope, F real, A... args)
+	{
+		if (scope.isRecording())
+			Capture::input(scope.data(), args...);
+		scope.start();
+		real(args...);
+		scope.stop();
+		if (scope.isRecording())
+			Capture::output(scope.data(), args...);
+	}
+};
+
+template <int ID, typename F> struct GLHook;
+
+template <int ID, typename R, typename... A>
+struct GLHook<ID, R (APIENTRY *)(A...)> {
+	static R (APIENTRY *real)(A...);
+
+	static R APIENTRY call (A... args)
+	{
+		GLCallScope scope(ID, args...);
+		return GLForward<R>::template call<GLCapture<ID> >(scope, real, args...);
+	}
+};
+
+template <int ID, typename R, typename... A>
+R (APIENTRY *GLHook<ID, R (APIENTRY *)(A...)>::real)(A...) = NULL;
+
+/* Wrap every loaded entry point - call once, after gladLoadGLLoader */
+inline void installGLHooks (bool timing)
+{
+	GLHookState& state = glHookState();
+	memset(state.FrameCalls, 0, sizeof(state.FrameCalls));
+	memset(state.TotalCalls, 0, sizeof(state.TotalCalls));
+	memset(state.TotalNanoseconds, 0, sizeof(state.TotalNanoseconds));
+	state.Timing = timing;
+	state.Capturing = false;
+	state.Frames = 0;
+	state.CapturePath = NULL;
+	state.CaptureFrames = 0;
+	state.CapturedFrames = 0;
+
+#define GLAD_USE(name) \
+	if (glad_##name != NULL) { \
+		GLHook<HOOK_##name, decltype(glad_##name)>::real = glad_##name; \
+		glad_##name = &GLHook<HOOK_##name, decltype(glad_##name)>::call; \
+	}
+#include "glad_used.inc"
+#undef GLAD_USE
+}
+
+/*
+ * Record every call from now on (resource uploads included) until 'frames'
+ * frames have ended, then write the stream to 'path'. The size is stored
+ * so the replayer can create a matching framebuffer.
+ */
+inline void captureGLFrames (const char* path, int frames, int width, int height)
+{
+	GLHookState& state = glHookState();
+	state.CapturePath = path;
+	state.CaptureFrames = frames;
+	state.CapturedFrames = 0;
+	state.CaptureWidth = width;
+	state.CaptureHeight = height;
+	state.Capturing = frames > 0;
+	state.Stream.clear();
+}
+
+inline void appendFrameMarker (std::vector<char>& out)
+{
+	appendBytes(out, GL_FRAME_MARKER);
+	out.insert(out.end(), GL_CALL_HEADER_BYTES - sizeof(GL_FRAME_MARKER), 0);
+}
+
+inline void beginGLHookFrame ()
+{
+	GLHookState& state = glHookState();
+	memset(state.FrameCalls, 0, sizeof(state.FrameCalls));
+	if (state.Capturing)
+		appendFrameMarker(state.Stream);
+}
+
+inline void writeGLCallStream (const char* path, const std::vector<char>& stream)
+{
+	FILE* out = fopen(path, "wb");
+	if (out == NULL) {
+		fprintf(stderr, "glhook: cannot write %s\n", path);
+		return;
+	}
+	GLHookState& state = glHookState();
+	unsigned int header[4] = { GL_CALL_STREAM_VERSION, state.CaptureWidth, state.CaptureHeight, GL_HOOK_COUNT };
+	fwrite("GLCS", 1, 4, out);
+	fwrite(header, sizeof(header), 1, out);
+	for (int i = 0; i < GL_HOOK_COUNT; i++) {
+		unsigned short length = (unsigned short) strlen(gl_hook_names[i]);
+		fwrite(&length, sizeof(length), 1, out);
+		fwrite(gl_hook_names[i], 1, length, out);
+	}
+	if (!stream.empty())
+		fwrite(&stream[0], 1, stream.size(), out);
+	fclose(out);
+}
+
+inline void endGLHookFrame ()
+{
+	GLHookState& state = glHookState();
+	for (int i = 0; i < GL_HOOK_COUNT; i++)
+		state.TotalCalls[i] += state.FrameCalls[i];
+	state.Frames++;
+	if (state.Capturing) {
+		if (++state.CapturedFrames == state.CaptureFrames) {
+			appendFrameMarker(state.Stream);
+			writeGLCallStream(state.CapturePath, state.Stream);
+			printf("GL call stream of %d frames written to %s (%d bytes)\n", state.CapturedFrames, state.CapturePath, (int) state.Stream.size());
+			state.Capturing = false;
+			state.CapturePath = NULL;
+			std::vector<char>().swap(state.Stream);
+		}
+	}
+}
+
+/* Average calls per frame by function, most frequent first */
+inline void printGLHookReport ()
+{
+	GLHookState& state = glHookState();
+	if (state.Frames == 0)
+		return;
+
+	std::vector<int> order;
+	unsigned long long total = 0;
+	for (int i = 0; i < GL_HOOK_COUNT; i++) {
+		total += state.TotalCalls[i];
+		if (state.TotalCalls[i] > 0)
+			order.push_back(i);
+	}
+	std::sort(order.begin(), order.end(), [&state] (int a, int b) { return state.TotalCalls[a] > state.TotalCalls[b]; });
+
+	printf("--- GL calls per frame (%d frames) ---\n", state.Frames);
+	for (size_t i = 0; i < order.size(); i++) {
+		int id = order[i];
+		printf("%-28s %10.1f", gl_hook_names[id], (double) state.TotalCalls[id] / state.Frames);
+		if (state.Timing)
+			printf("  %8.0f ns/call", state.TotalNanoseconds[id] / state.TotalCalls[id]);
+		printf("\n");
+	}
+	printf("%-28s %10.1f\n", "total", (double) total / state.Frames);
+}
+
+#endif
@@ -0,0 +1,173 @@
+#ifndef HANDLES_H
+#define HANDLES_H
+
+/*
+ * Generational handles for objects that own GL resources, and deletion
+ * deferred until the GPU has finished with them.
+ *
+ * A Handle is a slot index plus the generation the slot had when the
+ * handle was made. Every insert into a slot starts a new generation, so
+ * handles to an object that was removed go stale: get() returns NULL
+ * rather than a dangling pointer, even after the slot holds a new object.
+ *
+ * DeferredDeletes collects the release work of objects removed during a
+ * frame. endFrame() puts one fence behind the frame's batch and collect()
+ * runs the batches whose fence has signalled, without waiting; flush()
+ * waits for all of them, for teardown. Buffer ranges freed this way are
+ * only handed out again once no queued draw reads them, so reusing them
+ * never makes the driver stall or copy a buffer that is in flight.
+ */
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+
+struct Handle {
+	uint32_t Index;
+	uint32_t Generation;	// 0 for no object
+};
+
+const Handle NO_HANDLE = { 0, 0 };
+
+template <typename T>
+class HandlePool {
+public:
+	HandlePool () : live(0) {}
+
+	Handle insert (T* object)
+	{
+		uint32_t index;
+		if (!free_slots.empty()) {
+			index = free_slots.back();
+			free_slots.pop_back();
+		}
+		else {
+			index = slots.size();
+			Slot slot = { NULL, 0 };
+			slots.push_back(slot);
+		}
+		Slot& slot = slots[index];
+		slot.Object = object;
+		slot.Generation++;
+		live++;
+		Handle handle = { index, slot.Generation };
+		return handle;
+	}
+
+	/* The object, or NULL if the handle is stale or empty */
+	T* get (Handle handle) const
+	{
+		if (handle.Index >= slots.size() || slots[handle.Index].Generation != handle.Generation)
+			return NULL;
+		return slots[handle.Index].Object;
+	}
+
+	/* Take the object out of the pool - the caller deletes it */
+	T* remove (Handle handle)
+	{
+		T* object = get(handle);
+		if (object == NULL)
+			return NULL;
+		slots[handle.Index].Object = NULL;
+		free_slots.push_back(handle.Index);
+		live--;
+		return object;
+	}
+
+	/* Handles of every object in the pool, for bulk teardown */
+	std::vector<Handle> handles () const
+	{
+		std::vector<Handle> all;
+		for (uint32_t i = 0; i < slots.size(); i++) {
+			if (slots[i].Object != NULL) {
+				Handle handle = { i, slots[i].Generation };
+				all.push_back(handle);
+			}
+		}
+		return all;
+	}
+
+	size_t size () const { return live; }
+
+private:
+	struct Slot {
+		T* Object;
+		uint32_t Generation;
+	};
+
+	std::vector<Slot> slots;
+	std::vector<uint32_t> free_slots;
+	size_t live;
+};
+
+class DeferredDeletes {
+public:
+	/* Run 'release' once the GPU is done with everything submitted so far */
+	void defer (const std::function<void()>& release)
+	{
+		pending.push_back(release);
+	}
+
+	/* Call after the frame's last draw: fences the releases deferred during the frame */
+	void endFrame ()
+	{
+		if (pending.empty())
+			return;
+		Batch batch;
+		batch.Fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		batch.Releases.swap(pending);
+		batches.push_back(batch);
+	}
+
+	/* Run the batches the GPU has finished with, oldest first - never waits */
+	void collect ()
+	{
+		while (!batches.empty()) {
+			GLenum status = glClientWaitSync(batches.front().Fence, 0, 0);
+			if (status == GL_TIMEOUT_EXPIRED)
+				break;
+			run(batches.front());
+			batches.pop_front();
+		}
+	}
+
+	/* Wait for the GPU and run everything - for teardown */
+	void flush ()
+	{
+		endFrame();
+		if (batches.empty())
+			return;
+		glFinish();
+		while (!batches.empty()) {
+			run(batches.front());
+			batches.pop_front();
+		}
+	}
+
+	size_t pendingCount () const
+	{
+		size_t count = pending.size();
+		for (size_t i = 0; i < batches.size(); i++)
+			count += batches[i].Releases.size();
+		return count;
+	}
+
+private:
+	struct Batch {
+		GLsync Fence;
+		std::vector<std::function<void()> > Releases;
+	};
+
+	static void run (Batch& batch)
+	{
+		glDeleteSync(batch.Fence);
+		for (size_t i = 0; i < batch.Releases.size(); i++)
+			batch.Releases[i]();
+	}
+
+	std::vector<std::function<void()> > pending;
+	std::deque<Batch> batches;
+};
+
+#endif
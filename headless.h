@@ -0,0 +1,136 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+/*
+ * Offscreen rendering without a window system.
+ *
+ * Creates a GL 3.3 core context on EGL's surfaceless platform (Mesa, works
+ * with llvmpipe on machines without a display or GPU) and renders into an
+ * FBO that stands in for the window's framebuffer. Frames can be read back
+ * and written as binary PPM for golden-image comparisons.
+ *
+ * Only built with ENABLE_HEADLESS (make HEADLESS=1), links against libEGL.
+ */
+
+#define EGL_NO_X11
+#define MESA_EGL_NO_X11_HEADERS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <cstdio>
+#include <vector>
+
+struct HeadlessContext {
+	EGLDisplay Display;
+	EGLContext Context;
+	GLuint Framebuffer;
+	GLuint ColorBuffer;
+	GLuint DepthBuffer;
+	int Width;
+	int Height;
+};
+
+/* Create the context, load GL through glad and bind an FBO of the given size */
+inline bool initHeadless (HeadlessContext& ctx, int width, int height)
+{
+	ctx.Width = width;
+	ctx.Height = height;
+
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay == NULL) {
+		fprintf(stderr, "headless: eglGetPlatformDisplayEXT not available\n");
+		return false;
+	}
+
+	ctx.Display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	EGLint major, minor;
+	if (ctx.Display == EGL_NO_DISPLAY || !eglInitialize(ctx.Display, &major, &minor)) {
+		fprintf(stderr, "headless: cannot initialise the EGL surfaceless platform\n");
+		return false;
+	}
+
+	if (!eglBindAPI(EGL_OPENGL_API)) {
+		fprintf(stderr, "headless: desktop OpenGL not supported by EGL\n");
+		return false;
+	}
+
+	// Same context as initGLFW asks for: 3.3 core, forward compatible
+	const EGLint context_attribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_CONTEXT_OPENGL_FORWARD_COMPATIBLE, EGL_TRUE,
+		EGL_NONE
+	};
+	ctx.Context = eglCreateContext(ctx.Display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, context_attribs);
+	if (ctx.Context == EGL_NO_CONTEXT) {
+		fprintf(stderr, "headless: cannot create a GL 3.3 core context (EGL error 0x%x)\n", eglGetError());
+		return false;
+	}
+
+	// No surface at all - everything is drawn into the FBO below
+	if (!eglMakeCurrent(ctx.Display, EGL_NO_SURFACE, EGL_NO_SURFACE, ctx.Context)) {
+		fprintf(stderr, "headless: eglMakeCurrent failed (EGL error 0x%x)\n", eglGetError());
+		return false;
+	}
+
+	if (!gladLoadGLLoader((GLADloadproc) eglGetProcAddress)) {
+		fprintf(stderr, "headless: cannot load GL functions\n");
+		return false;
+	}
+
+	glGenRenderbuffers(1, &ctx.ColorBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, ctx.ColorBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+	glGenRenderbuffers(1, &ctx.DepthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, ctx.DepthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+
+	glGenFramebuffers(1, &ctx.Framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, ctx.Framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, ctx.ColorBuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, ctx.DepthBuffer);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		fprintf(stderr, "headless: framebuffer incomplete\n");
+		return false;
+	}
+
+	return true;
+}
+
+/* Write the current contents of the FBO as a binary PPM, top row first */
+inline bool dumpHeadlessFrame (const HeadlessContext& ctx, const char* path)
+{
+	std::vector<unsigned char> pixels(3 * ctx.Width * ctx.Height);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, ctx.Framebuffer);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, ctx.Width, ctx.Height, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
+
+	FILE* out = fopen(path, "wb");
+	if (out == NULL) {
+		fprintf(stderr, "headless: cannot write %s\n", path);
+		return false;
+	}
+	fprintf(out, "P6\n%d %d\n255\n", ctx.Width, ctx.Height);
+	// GL rows start at the bottom
+	for (int y = ctx.Height - 1; y >= 0; y--)
+		fwrite(&pixels[3 * ctx.Width * y], 1, 3 * ctx.Width, out);
+	fclose(out);
+	return true;
+}
+
+inline void destroyHeadless (HeadlessContext& ctx)
+{
+	glDeleteFramebuffers(1, &ctx.Framebuffer);
+	glDeleteRenderbuffers(1, &ctx.ColorBuffer);
+	glDeleteRenderbuffers(1, &ctx.DepthBuffer);
+	eglMakeCurrent(ctx.Display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	eglDestroyContext(ctx.Display, ctx.Context);
+	eglTerminate(ctx.Display);
+}
+
+#endif
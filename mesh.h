@@ -0,0 +1,161 @@
+#ifndef MESH_H
+#define MESH_H
+
+/*
+ * Mesh data, generated at compile time - no GL calls and no work at startup.
+ * Only the GL types and enums are needed, include after glad.
+ *
+ * Every object in the game is a box. CubeMesh<Width, Length, Height, Color>
+ * expands a shared corner/index table into the 36 vertices glDrawArrays
+ * needs, scaled to the box size (in hundredths of a unit, template arguments
+ * cannot be floats). Vertices carry the number of their face instead of a
+ * colour; the colour policy gives the six face colours, which go into a
+ * palette the shaders index by face (see setBoxPalette in procedural.h).
+ * The arrays are constexpr std::arrays, so the static_asserts below check
+ * the actual data that is uploaded.
+ */
+
+#include <array>
+#include <cstddef>
+#include <utility>
+
+const int CUBE_VERTICES = 36;
+
+/* Unit cube corners: bit 0/1/2 set means +x/+y/+z */
+constexpr GLfloat cubeCorner (int corner, int axis)
+{
+	return (corner >> axis) & 1 ? 0.5f : -0.5f;
+}
+
+/* Two triangles per face. Faces in order: back (-z), top (+y), right (+x),
+   bottom (-y), front (+z), left (-x) - colour policies use these numbers */
+constexpr int CUBE_INDICES [CUBE_VERTICES] = {
+	0, 1, 3,  3, 2, 0,
+	3, 2, 6,  6, 7, 3,
+	7, 3, 1,  1, 5, 7,
+	0, 1, 5,  5, 4, 0,
+	7, 5, 4,  4, 6, 7,
+	0, 2, 6,  6, 4, 0,
+};
+
+/* Axis each face is perpendicular to, and whether it is on the + side */
+constexpr int CUBE_FACE_AXIS [6] = { 2, 1, 0, 1, 2, 0 };
+constexpr bool CUBE_FACE_POSITIVE [6] = { false, true, true, false, true, false };
+
+/* Coordinate i of the vertex array (vertex i/3, axis i%3) */
+template <int Width, int Length, int Height>
+constexpr GLfloat cubeVertex (int i)
+{
+	return cubeCorner(CUBE_INDICES[i / 3], i % 3) * ((i % 3 == 0 ? Width : i % 3 == 1 ? Length : Height) / 100.0f);
+}
+
+/* Face of vertex i - six vertices per face, in CUBE_INDICES order */
+constexpr GLubyte cubeFace (int i)
+{
+	return i / 6;
+}
+
+template <int Width, int Length, int Height, std::size_t... I>
+constexpr std::array<GLfloat, sizeof...(I)> cubeVertices (std::index_sequence<I...>)
+{
+	return {{ cubeVertex<Width, Length, Height>(I)... }};
+}
+
+template <std::size_t... I>
+constexpr std::array<GLubyte, sizeof...(I)> cubeFaces (std::index_sequence<I...>)
+{
+	return {{ cubeFace(I)... }};
+}
+
+/* A box of Width x Length x Height hundredths, coloured per face by Color */
+template <int Width, int Length, int Height, typename Color>
+struct CubeMesh {
+	static constexpr GLenum PrimitiveMode = GL_TRIANGLES;
+	static constexpr GLenum FillMode = GL_FILL;
+	static constexpr int NumVertices = CUBE_VERTICES;
+	static constexpr std::array<GLfloat, 3*CUBE_VERTICES> Vertices = cubeVertices<Width, Length, Height>(std::make_index_sequence<3*CUBE_VERTICES>());
+	static constexpr std::array<GLubyte, CUBE_VERTICES> Faces = cubeFaces(std::make_index_sequence<CUBE_VERTICES>());
+
+	/* Edge length along x, y or z */
+	static constexpr GLfloat size (int axis)
+	{
+		return (axis == 0 ? Width : axis == 1 ? Length : Height) / 100.0f;
+	}
+
+	static constexpr GLfloat faceColor (int face, int channel)
+	{
+		return Color::faceColor(face, channel);
+	}
+};
+
+template <int Width, int Length, int Height, typename Color>
+constexpr std::array<GLfloat, 3*CUBE_VERTICES> CubeMesh<Width, Length, Height, Color>::Vertices;
+template <int Width, int Length, int Height, typename Color>
+constexpr std::array<GLubyte, CUBE_VERTICES> CubeMesh<Width, Length, Height, Color>::Faces;
+
+/* Colour policies: faceColor(face, channel) */
+
+/* One colour for the whole box, channels in hundredths */
+template <int Red, int Green, int Blue>
+struct SolidColor {
+	static constexpr GLfloat faceColor (int, int channel)
+	{
+		return (channel == 0 ? Red : channel == 1 ? Green : Blue) / 100.0f;
+	}
+};
+
+constexpr GLfloat BOARD_FACE_COLORS [6][3] = {
+	{ 0.2, 0.1, 0.7 },
+	{ 0.4, 0.5, 0.5 },
+	{ 0.2, 0.4, 0.6 },
+	{ 0.1, 0.2, 0.6 },
+	{ 0.1, 0.7, 0.7 },
+	{ 0.4, 0.4, 0.4 },
+};
+
+/* The board tile's shade of blue-grey per face */
+struct BoardColors {
+	static constexpr GLfloat faceColor (int face, int channel)
+	{
+		return BOARD_FACE_COLORS[face][channel];
+	}
+};
+
+/* Checks on generated meshes, used by the static_asserts below */
+
+/* Every vertex lies in the plane of the face it is numbered with */
+template <typename Mesh>
+constexpr bool cubeFacesFlat ()
+{
+	for (int v = 0; v < Mesh::NumVertices; v++) {
+		int face = Mesh::Faces[v];
+		int axis = CUBE_FACE_AXIS[face];
+		GLfloat first = Mesh::Vertices[3*(face*6) + axis];
+		if (Mesh::Vertices[3*v + axis] != first || (first > 0) != CUBE_FACE_POSITIVE[face])
+			return false;
+	}
+	return true;
+}
+
+/* Every face colour of the palette entry is within [0, 1] */
+template <typename Mesh>
+constexpr bool cubeColorsInRange ()
+{
+	for (int face = 0; face < 6; face++) {
+		for (int channel = 0; channel < 3; channel++) {
+			GLfloat c = Mesh::faceColor(face, channel);
+			if (c < 0 || c > 1)
+				return false;
+		}
+	}
+	return true;
+}
+
+typedef CubeMesh<100, 100, 100, BoardColors> BoardMesh;
+typedef CubeMesh<80, 100, 80, SolidColor<40, 20, 0> > ObstacleMesh;
+typedef CubeMesh<40, 100, 40, SolidColor<100, 0, 50> > PersonMesh;
+
+static_assert(cubeFacesFlat<BoardMesh>() && cubeFacesFlat<ObstacleMesh>() && cubeFacesFlat<PersonMesh>(), "cube face not planar");
+static_assert(cubeColorsInRange<BoardMesh>() && cubeColorsInRange<ObstacleMesh>() && cubeColorsInRange<PersonMesh>(), "face colour out of range");
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+/*
+ * Interning of uploaded meshes by content, so objects with the same mesh
+ * share one upload (30 obstacles on the board: one upload for all of them).
+ *
+ * Meshes are keyed on a 64 bit FNV-1a hash of their vertex and face data
+ * plus the primitive and fill mode. The cache keeps a copy of the data and
+ * compares it on a hash match, so a collision can only cost a lookup, never
+ * hand out the wrong mesh. Reference counts live with the meshes themselves
+ * (struct VAO in game2.cpp); the cache only maps content to mesh.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+/* Everything that makes two meshes the same */
+struct MeshKey {
+	uint64_t Hash;
+	GLenum PrimitiveMode;
+	GLenum FillMode;
+	int NumVertices;
+};
+
+/* FNV-1a over raw bytes, continuing from 'hash' */
+inline uint64_t hashBytes (const void* data, size_t size, uint64_t hash = 14695981039346656037ULL)
+{
+	const unsigned char* bytes = (const unsigned char*) data;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+inline MeshKey meshKey (GLenum primitive_mode, GLenum fill_mode, int numVertices, const GLfloat* vertices, const GLubyte* faces)
+{
+	MeshKey key;
+	key.PrimitiveMode = primitive_mode;
+	key.FillMode = fill_mode;
+	key.NumVertices = numVertices;
+	key.Hash = hashBytes(vertices, 3*numVertices*sizeof(GLfloat));
+	key.Hash = hashBytes(faces, numVertices, key.Hash);
+	key.Hash = hashBytes(&primitive_mode, sizeof(primitive_mode), key.Hash);
+	key.Hash = hashBytes(&fill_mode, sizeof(fill_mode), key.Hash);
+	return key;
+}
+
+template <typename Mesh>
+class MeshCache {
+public:
+	MeshCache () : lookups(0), hits(0) {}
+
+	/* The mesh uploaded with this content, or NULL */
+	Mesh* find (const MeshKey& key, const GLfloat* vertices, const GLubyte* faces)
+	{
+		lookups++;
+		std::pair<typename Entries::iterator, typename Entries::iterator> range = entries.equal_range(key.Hash);
+		for (typename Entries::iterator it = range.first; it != range.second; ++it) {
+			if (same(it->second, key, vertices, faces)) {
+				hits++;
+				return it->second.Value;
+			}
+		}
+		return NULL;
+	}
+
+	void insert (const MeshKey& key, const GLfloat* vertices, const GLubyte* faces, Mesh* mesh)
+	{
+		Entry entry;
+		entry.Key = key;
+		entry.Vertices.assign(vertices, vertices + 3*key.NumVertices);
+		entry.Faces.assign(faces, faces + key.NumVertices);
+		entry.Value = mesh;
+		entries.insert(std::make_pair(key.Hash, entry));
+	}
+
+	/* Forget a mesh, once its last reference is gone */
+	void erase (const MeshKey& key, Mesh* mesh)
+	{
+		std::pair<typename Entries::iterator, typename Entries::iterator> range = entries.equal_range(key.Hash);
+		for (typename Entries::iterator it = range.first; it != range.second; ++it) {
+			if (it->second.Value == mesh) {
+				entries.erase(it);
+				return;
+			}
+		}
+	}
+
+	size_t size () const { return entries.size(); }
+	int lookupCount () const { return lookups; }
+	int hitCount () const { return hits; }	// lookups that found a mesh to share
+
+private:
+	struct Entry {
+		MeshKey Key;
+		std::vector<GLfloat> Vertices;
+		std::vector<GLubyte> Faces;
+		Mesh* Value;
+	};
+	typedef std::unordered_multimap<uint64_t, Entry> Entries;
+
+	static bool same (const Entry& entry, const MeshKey& key, const GLfloat* vertices, const GLubyte* faces)
+	{
+		return entry.Key.PrimitiveMode == key.PrimitiveMode && entry.Key.FillMode == key.FillMode
+			&& entry.Key.NumVertices == key.NumVertices
+			&& memcmp(&entry.Vertices[0], vertices, 3*key.NumVertices*sizeof(GLfloat)) == 0
+			&& memcmp(&entry.Faces[0], faces, key.NumVertices) == 0;
+	}
+
+	Entries entries;
+	int lookups;
+	int hits;
+};
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef MOVES_H
+#define MOVES_H
+
+/*
+ * Move resolution for the person on the 10x10 board - pure game logic, no
+ * GL or GLFW, so it can be benchmarked on its own.
+ *
+ * Tiles are numbered 99 (start, bottom left) down to 0 (goal). A tile is a
+ * pit when its number % 8 == 5 and holds an obstacle when % 6 == 1.
+ */
+
+struct PersonState {
+	float PosX, PosY, PosZ;
+	int BlockPos;
+	int Lives;
+	bool Jump;	// the next move skips a tile
+};
+
+enum MoveDirection { MOVE_RIGHT, MOVE_LEFT, MOVE_UP, MOVE_DOWN };
+
+enum MoveResult { MOVE_DONE, MOVE_FELL, MOVE_NONE };
+
+inline bool isPit (int block) { return block % 8 == 5; }
+inline bool isObstacle (int block) { return block % 6 == 1; }
+
+/* Move one tile (two when jumping) - off the board or into an obstacle
+   leaves the person where it was, a pit costs a life and sends it back */
+inline MoveResult resolveMove (PersonState& person, MoveDirection direction)
+{
+	// Right/left move along z one tile number at a time, up/down along x ten at a time
+	bool along_x = direction == MOVE_UP || direction == MOVE_DOWN;
+	float sign = (direction == MOVE_RIGHT || direction == MOVE_UP) ? 1 : -1;
+	int block_step = along_x ? 10 : 1;
+
+	int steps = person.Jump ? 2 : 1;
+	person.Jump = false;
+
+	float& pos = along_x ? person.PosX : person.PosZ;
+	float limit = 4.5 - (steps - 1);
+	if (sign * pos >= limit)
+		return MOVE_NONE;
+
+	pos += sign * steps;
+	person.BlockPos -= (int) sign * steps * block_step;
+	if (isPit(person.BlockPos)) {
+		person.BlockPos = 99;
+		person.PosY = 0;
+		person.Lives--;
+		return MOVE_FELL;
+	}
+	if (isObstacle(person.BlockPos)) {
+		pos -= sign * steps;
+		person.BlockPos += (int) sign * steps * block_step;
+	}
+	return MOVE_DONE;
+}
+
+#endif
@@ -0,0 +1,167 @@
+#ifndef PROCEDURAL_H
+#define PROCEDURAL_H
+
+/*
+ * Boxes drawn without vertex buffers (./game2 --render procedural).
+ *
+ * The whole scene is one glDrawArraysInstanced of 36 vertices per box.
+ * Sample_GL.vert, compiled with PROCEDURAL defined, makes each corner from
+ * gl_VertexID and reads its box from a buffer texture: one RGBA32F texel per
+ * instance, the position and the box type. The size and face colours of
+ * each box type (the palette) are uniforms, taken from the CubeMesh types
+ * in mesh.h, so both render modes draw the same boxes - but a tile costs
+ * 16 bytes of GPU memory instead of 864 bytes of mesh arena (arena.h).
+ *
+ * './game2 --render points' goes one step further: one GL_POINTS vertex per
+ * tile, its position and TileType, and Tiles.geom expands each point into
+ * the tile's boxes - none for a pit, the board box, and the obstacle on top.
+ * Same palette, and the same 16 bytes per tile, but pits and obstacles cost
+ * no extra instances.
+ */
+
+#include <vector>
+
+#include "mesh.h"
+
+/* Palette entries - at most MAX_BOX_TYPES in Sample_GL.vert */
+enum BoxType { BOX_BOARD, BOX_OBSTACLE, BOX_PERSON, NUM_BOX_TYPES };
+
+/* One texel of the instance buffer */
+struct BoxInstance {
+	GLfloat X, Y, Z;
+	GLfloat Type;	// BoxType
+};
+
+struct ProceduralBoxes {
+	GLuint VertexArray;	// no attributes, core profile draws need one bound
+	GLuint InstanceBuffer;
+	GLuint InstanceTexture;
+	std::vector<BoxInstance> Instances;	// what the buffer holds
+};
+
+template <typename Mesh>
+void addBoxType (std::vector<GLfloat>& sizes, std::vector<GLfloat>& colors)
+{
+	for (int axis = 0; axis < 3; axis++)
+		sizes.push_back(Mesh::size(axis));
+	for (int face = 0; face < 6; face++)
+		for (int channel = 0; channel < 3; channel++)
+			colors.push_back(Mesh::faceColor(face, channel));
+}
+
+/* Size (3 floats) and six face colours (18 floats) of every BoxType, in order */
+inline void boxPalette (std::vector<GLfloat>& sizes, std::vector<GLfloat>& colors)
+{
+	addBoxType<BoardMesh>(sizes, colors);
+	addBoxType<ObstacleMesh>(sizes, colors);
+	addBoxType<PersonMesh>(sizes, colors);
+}
+
+/* Point the program's palette and instance sampler at the boxes - the program must be in use */
+inline void setBoxPalette (GLuint program)
+{
+	std::vector<GLfloat> sizes, colors;
+	boxPalette(sizes, colors);
+	glUniform3fv(glGetUniformLocation(program, "BoxSize"), NUM_BOX_TYPES, &sizes[0]);
+	glUniform3fv(glGetUniformLocation(program, "FaceColor"), 6 * NUM_BOX_TYPES, &colors[0]);
+	glUniform1i(glGetUniformLocation(program, "Instances"), 0);	// texture unit 0
+}
+
+inline void createProceduralBoxes (ProceduralBoxes& boxes, const std::vector<BoxInstance>& instances)
+{
+	boxes.Instances = instances;
+	glGenVertexArrays(1, &boxes.VertexArray);
+	glGenBuffers(1, &boxes.InstanceBuffer);
+	glGenTextures(1, &boxes.InstanceTexture);
+
+	glBindBuffer(GL_TEXTURE_BUFFER, boxes.InstanceBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, instances.size() * sizeof(BoxInstance), instances.empty() ? NULL : &instances[0], GL_STATIC_DRAW);
+	glBindTexture(GL_TEXTURE_BUFFER, boxes.InstanceTexture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, boxes.InstanceBuffer);
+}
+
+/* Move one box, uploading only its texel and only if it changed */
+inline void updateBoxInstance (ProceduralBoxes& boxes, size_t i, const BoxInstance& instance)
+{
+	BoxInstance& current = boxes.Instances[i];
+	if (current.X == instance.X && current.Y == instance.Y && current.Z == instance.Z && current.Type == instance.Type)
+		return;
+	current = instance;
+	glBindBuffer(GL_TEXTURE_BUFFER, boxes.InstanceBuffer);
+	glBufferSubData(GL_TEXTURE_BUFFER, i * sizeof(BoxInstance), sizeof(BoxInstance), &current);
+}
+
+/* Draw every box - the program with the palette must be in use */
+inline void drawProceduralBoxes (const ProceduralBoxes& boxes)
+{
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	glBindTexture(GL_TEXTURE_BUFFER, boxes.InstanceTexture);
+	glBindVertexArray(boxes.VertexArray);
+	glDrawArraysInstanced(GL_TRIANGLES, 0, CUBE_VERTICES, boxes.Instances.size());
+}
+
+inline void destroyProceduralBoxes (ProceduralBoxes& boxes)
+{
+	glDeleteTextures(1, &boxes.InstanceTexture);
+	glDeleteBuffers(1, &boxes.InstanceBuffer);
+	glDeleteVertexArrays(1, &boxes.VertexArray);
+	boxes.InstanceTexture = boxes.InstanceBuffer = boxes.VertexArray = 0;
+	boxes.Instances.clear();
+}
+
+/* What a tile point expands to - must match Tiles.geom */
+enum TileType { TILE_FLOOR, TILE_OBSTACLE, TILE_PIT, TILE_PERSON };
+
+/* One vertex of the point buffer */
+struct TilePoint {
+	GLfloat X, Y, Z;
+	GLfloat Type;	// TileType
+};
+
+struct TilePoints {
+	GLuint VertexArray;
+	GLuint PointBuffer;
+	std::vector<TilePoint> Points;	// what the buffer holds
+};
+
+inline void createTilePoints (TilePoints& tiles, const std::vector<TilePoint>& points)
+{
+	tiles.Points = points;
+	glGenVertexArrays(1, &tiles.VertexArray);
+	glGenBuffers(1, &tiles.PointBuffer);
+
+	glBindVertexArray(tiles.VertexArray);
+	glBindBuffer(GL_ARRAY_BUFFER, tiles.PointBuffer);
+	glBufferData(GL_ARRAY_BUFFER, points.size() * sizeof(TilePoint), points.empty() ? NULL : &points[0], GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(TilePoint), (void*) 0);
+	glEnableVertexAttribArray(0);
+}
+
+/* Move one point, uploading only its vertex and only if it changed */
+inline void updateTilePoint (TilePoints& tiles, size_t i, const TilePoint& point)
+{
+	TilePoint& current = tiles.Points[i];
+	if (current.X == point.X && current.Y == point.Y && current.Z == point.Z && current.Type == point.Type)
+		return;
+	current = point;
+	glBindBuffer(GL_ARRAY_BUFFER, tiles.PointBuffer);
+	glBufferSubData(GL_ARRAY_BUFFER, i * sizeof(TilePoint), sizeof(TilePoint), &current);
+}
+
+/* Draw every tile - the program with Tiles.geom and the palette must be in use */
+inline void drawTilePoints (const TilePoints& tiles)
+{
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	glBindVertexArray(tiles.VertexArray);
+	glDrawArrays(GL_POINTS, 0, tiles.Points.size());
+}
+
+inline void destroyTilePoints (TilePoints& tiles)
+{
+	glDeleteBuffers(1, &tiles.PointBuffer);
+	glDeleteVertexArrays(1, &tiles.VertexArray);
+	tiles.PointBuffer = tiles.VertexArray = 0;
+	tiles.Points.clear();
+}
+
+#endif
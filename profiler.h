@@ -0,0 +1,316 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+/*
+ * Per-frame CPU/GPU profiler.
+ *
+ * CPU sections are timed with steady_clock. The GPU pass of each frame is
+ * wrapped in a GL_TIME_ELAPSED query; queries live in a ring of GPU_RING
+ * frames and are only read back once GL_QUERY_RESULT_AVAILABLE says so, so
+ * the profiler never waits on the GPU (a frame whose slot is still busy is
+ * simply not GPU-timed).
+ *
+ * The report window keeps every sample and is emptied when taken; the
+ * whole-run totals only keep log-spaced histograms (TimeHistogram), so a
+ * long run does not grow the profiler.
+ *
+ * Requires a current GL 3.3 context - include after glad. destroy() deletes
+ * the queries, while the context is still current.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+/* Distribution of times in fixed memory: buckets RATIO apart from MIN_MS up,
+ * a percentile is the geometric middle of its bucket, within 0.5% */
+class TimeHistogram {
+public:
+	TimeHistogram () : count(0), min_ms(0), max_ms(0) { std::fill(buckets, buckets + NUM_BUCKETS, 0u); }
+
+	void add (double ms)
+	{
+		int bucket = 0;
+		if (ms >= MIN_MS)
+			bucket = std::min(NUM_BUCKETS - 1, 1 + (int) (std::log(ms / MIN_MS) / std::log(RATIO)));
+		buckets[bucket]++;
+		min_ms = count == 0 ? ms : std::min(min_ms, ms);
+		max_ms = count == 0 ? ms : std::max(max_ms, ms);
+		count++;
+	}
+
+	int size () const { return count; }
+
+	/* Nearest-rank percentile, clamped to the smallest and largest sample */
+	double percentile (double p) const
+	{
+		if (count == 0)
+			return 0;
+		int rank = std::max(1, (int) std::ceil(p / 100.0 * count));
+		int bucket = 0;
+		int seen = buckets[0];
+		while (seen < rank)
+			seen += buckets[++bucket];
+		if (bucket == NUM_BUCKETS - 1)
+			return max_ms;
+		double value = bucket == 0 ? 0 : MIN_MS * std::pow(RATIO, bucket - 0.5);
+		return std::min(max_ms, std::max(min_ms, value));
+	}
+
+private:
+	static constexpr double MIN_MS = 0.001;	// below: bucket 0
+	static constexpr double RATIO = 1.01;
+	static const int NUM_BUCKETS = 1621;	// up to 10 s, the last bucket reports the longest sample
+
+	unsigned buckets[NUM_BUCKETS];
+	int count;
+	double min_ms;
+	double max_ms;
+};
+
+class FrameProfiler {
+public:
+	enum Section { DRAW, SWAP, POLL, SIMULATION, NUM_SECTIONS };
+
+	/* Summary of a set of frames, all times in milliseconds */
+	struct Stats {
+		int Frames;
+		double Frame[3];	// p50, p95, p99
+		double Sections[NUM_SECTIONS][3];
+		double Gpu[3];
+		int GpuFrames;
+		double DrawCallsAvg;
+		int DrawCallsMax;
+	};
+
+	FrameProfiler () : enabled(false), gpu_active(false), frame_index(0), draw_calls(0) {}
+
+	void init ()
+	{
+		enabled = true;
+		glGenQueries(GPU_RING, queries);
+		for (int i = 0; i < GPU_RING; i++)
+			query_pending[i] = false;
+		frame_start = std::chrono::steady_clock::now();
+	}
+
+	void destroy ()
+	{
+		if (!enabled)
+			return;
+		glDeleteQueries(GPU_RING, queries);
+		enabled = false;
+	}
+
+	bool isEnabled () const { return enabled; }
+	static int queryCount () { return GPU_RING; }
+	GLuint query (int i) const { return queries[i]; }	// for the resource registry
+
+	void beginFrame ()
+	{
+		if (!enabled)
+			return;
+		for (int i = 0; i < NUM_SECTIONS; i++)
+			section_ms[i] = 0;
+		draw_calls = 0;
+		collectGpu();
+	}
+
+	void endFrame ()
+	{
+		if (!enabled)
+			return;
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		double frame_ms = std::chrono::duration<double, std::milli>(now - frame_start).count();
+		frame_start = now;
+		frame_index++;
+
+		window.Frame.push_back(frame_ms);
+		total.Frame.add(frame_ms);
+		for (int i = 0; i < NUM_SECTIONS; i++) {
+			window.Sections[i].push_back(section_ms[i]);
+			total.Sections[i].add(section_ms[i]);
+		}
+		window.DrawCalls.push_back(draw_calls);
+		total.DrawCallsSum += draw_calls;
+		total.DrawCallsMax = std::max(total.DrawCallsMax, draw_calls);
+	}
+
+	void beginSection (Section section)
+	{
+		section_begin[section] = std::chrono::steady_clock::now();
+	}
+
+	void endSection (Section section)
+	{
+		section_ms[section] += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - section_begin[section]).count();
+	}
+
+	/* Wrap the GL commands of the frame */
+	void beginGpu ()
+	{
+		if (!enabled)
+			return;
+		int slot = frame_index % GPU_RING;
+		gpu_active = !query_pending[slot];
+		if (gpu_active)
+			glBeginQuery(GL_TIME_ELAPSED, queries[slot]);
+	}
+
+	void endGpu ()
+	{
+		if (!enabled || !gpu_active)
+			return;
+		glEndQuery(GL_TIME_ELAPSED);
+		query_pending[frame_index % GPU_RING] = true;
+		gpu_active = false;
+	}
+
+	void countDrawCall () { draw_calls++; }
+
+	/* Stats for the frames since the last call, then start a new window */
+	Stats takeWindow ()
+	{
+		Stats stats = summarize(window);
+		window = Samples();
+		return stats;
+	}
+
+	/* Stats for every frame since init, percentiles from the histograms */
+	Stats totals () const
+	{
+		Stats stats;
+		stats.Frames = total.Frame.size();
+		fill(stats.Frame, total.Frame);
+		for (int i = 0; i < NUM_SECTIONS; i++)
+			fill(stats.Sections[i], total.Sections[i]);
+		fill(stats.Gpu, total.Gpu);
+		stats.GpuFrames = total.Gpu.size();
+		stats.DrawCallsAvg = stats.Frames == 0 ? 0 : (double) total.DrawCallsSum / stats.Frames;
+		stats.DrawCallsMax = total.DrawCallsMax;
+		return stats;
+	}
+
+	static void print (const char* title, const Stats& stats)
+	{
+		static const char* names[NUM_SECTIONS] = { "draw", "swap", "poll", "simulation" };
+		printf("--- %s: %d frames ---\n", title, stats.Frames);
+		printf("%-12s %9s %9s %9s  (ms)\n", "", "p50", "p95", "p99");
+		printf("%-12s %9.3f %9.3f %9.3f\n", "frame", stats.Frame[0], stats.Frame[1], stats.Frame[2]);
+		for (int i = 0; i < NUM_SECTIONS; i++)
+			printf("%-12s %9.3f %9.3f %9.3f\n", names[i], stats.Sections[i][0], stats.Sections[i][1], stats.Sections[i][2]);
+		printf("%-12s %9.3f %9.3f %9.3f  (%d frames timed)\n", "gpu", stats.Gpu[0], stats.Gpu[1], stats.Gpu[2], stats.GpuFrames);
+		printf("draw calls/frame: %.1f avg, %d max\n", stats.DrawCallsAvg, stats.DrawCallsMax);
+	}
+
+	/* Nearest-rank percentile, sorts a copy */
+	static double percentile (std::vector<double> values, double p)
+	{
+		if (values.empty())
+			return 0;
+		std::sort(values.begin(), values.end());
+		size_t rank = (size_t) std::max(1.0, std::ceil(p / 100.0 * values.size()));
+		return values[std::min(rank, values.size()) - 1];
+	}
+
+private:
+	static const int GPU_RING = 4;
+
+	struct Samples {
+		std::vector<double> Frame;
+		std::vector<double> Sections[NUM_SECTIONS];
+		std::vector<double> Gpu;
+		std::vector<int> DrawCalls;
+	};
+
+	struct Totals {
+		Totals () : DrawCallsSum(0), DrawCallsMax(0) {}
+
+		TimeHistogram Frame;
+		TimeHistogram Sections[NUM_SECTIONS];
+		TimeHistogram Gpu;
+		long long DrawCallsSum;
+		int DrawCallsMax;
+	};
+
+	/* Read back every finished query without blocking */
+	void collectGpu ()
+	{
+		for (int i = 0; i < GPU_RING; i++) {
+			if (!query_pending[i])
+				continue;
+			GLint available = 0;
+			glGetQueryObjectiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available)
+				continue;
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &elapsed);
+			query_pending[i] = false;
+			window.Gpu.push_back(elapsed / 1.0e6);
+			total.Gpu.add(elapsed / 1.0e6);
+		}
+	}
+
+	static void fill (double out[3], const std::vector<double>& values)
+	{
+		out[0] = percentile(values, 50);
+		out[1] = percentile(values, 95);
+		out[2] = percentile(values, 99);
+	}
+
+	static void fill (double out[3], const TimeHistogram& histogram)
+	{
+		out[0] = histogram.percentile(50);
+		out[1] = histogram.percentile(95);
+		out[2] = histogram.percentile(99);
+	}
+
+	static Stats summarize (const Samples& samples)
+	{
+		Stats stats;
+		stats.Frames = (int) samples.Frame.size();
+		fill(stats.Frame, samples.Frame);
+		for (int i = 0; i < NUM_SECTIONS; i++)
+			fill(stats.Sections[i], samples.Sections[i]);
+		fill(stats.Gpu, samples.Gpu);
+		stats.GpuFrames = (int) samples.Gpu.size();
+		long long sum = 0;
+		stats.DrawCallsMax = 0;
+		for (size_t i = 0; i < samples.DrawCalls.size(); i++) {
+			sum += samples.DrawCalls[i];
+			stats.DrawCallsMax = std::max(stats.DrawCallsMax, samples.DrawCalls[i]);
+		}
+		stats.DrawCallsAvg = samples.DrawCalls.empty() ? 0 : (double) sum / samples.DrawCalls.size();
+		return stats;
+	}
+
+	bool enabled;
+	bool gpu_active;
+	int frame_index;
+	int draw_calls;
+	GLuint queries[GPU_RING];
+	bool query_pending[GPU_RING];
+	double section_ms[NUM_SECTIONS];
+	std::chrono::steady_clock::time_point section_begin[NUM_SECTIONS];
+	std::chrono::steady_clock::time_point frame_start;
+	Samples window;
+	Totals total;
+};
+
+/* Times the enclosing block as one section of the frame */
+class ProfileSection {
+public:
+	ProfileSection (FrameProfiler& profiler, FrameProfiler::Section section) : profiler(profiler), section(section)
+	{
+		profiler.beginSection(section);
+	}
+	~ProfileSection () { profiler.endSection(section); }
+
+private:
+	FrameProfiler& profiler;
+	FrameProfiler::Section section;
+};
+
+#endif
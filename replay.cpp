@@ -0,0 +1,710 @@
+/*
+ * Replays a GL call stream captured with './game2 --gl-capture <file>' as
+ * fast as possible, without game logic, input or vsync, and prints the
+ * timings as one line of JSON:
+ *
+ *   ./replay [--headless] [--loops N] [--dump last.ppm] capture.glcs
+ *
+ * Everything before the first frame (shader compilation, buffer uploads) is
+ * run once and timed as setup; the captured frames are then replayed
+ * --loops times. Object names, shader/program names and uniform
+ * locations are remapped to the ones the replaying driver hands out; the
+ * framebuffer the game rendered to is replaced by the replay's own.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <map>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "profiler.h"
+#include "glhook.h"
+#ifdef ENABLE_HEADLESS
+#include "headless.h"
+#endif
+
+using namespace std;
+
+/* One recorded call, pointing into the loaded file */
+struct ReplayCall {
+	int Function;	// recorded function id
+	const char* Args;
+	const char* Data;
+	unsigned int DataBytes;
+};
+
+/* Recorded object name -> name in this context */
+typedef map<GLuint, GLuint> NameMap;
+
+struct ReplayFunction;
+typedef void (*ReplayHandler)(const ReplayCall& call, const ReplayFunction& function);
+
+struct ReplayFunction {
+	string Name;
+	ReplayHandler Handler;
+	void* Proc;	// glad's pointer for the function
+	NameMap* Names;	// objects the function creates or deletes
+};
+
+NameMap buffers, vertex_arrays, queries, framebuffers, renderbuffers, textures, shaders, programs;
+map<pair<GLuint, GLint>, GLint> uniform_locations;	// (recorded program, recorded location)
+map<pair<GLuint, GLuint>, GLuint> uniform_blocks;	// (recorded program, recorded block index)
+GLuint current_program = 0;	// recorded name
+GLuint replay_framebuffer = 0;
+vector<char> read_pixels;
+
+/* Reads packed arguments in declaration order */
+class ArgReader {
+public:
+	explicit ArgReader (const char* args) : args(args) {}
+
+	template <typename T>
+	T next ()
+	{
+		T value;
+		memcpy(&value, args, sizeof(T));
+		args += sizeof(T);
+		return value;
+	}
+
+private:
+	const char* args;
+};
+
+GLuint mapName (const NameMap& names, GLuint name)
+{
+	NameMap::const_iterator it = names.find(name);
+	return it == names.end() ? name : it->second;
+}
+
+/* Calls made with only plain values are forwarded as they are */
+template <int... I> struct Indices {};
+template <int N, int... I> struct MakeIndices : MakeIndices<N - 1, N - 1, I...> {};
+template <int... I> struct MakeIndices<0, I...> { typedef Indices<I...> Type; };
+
+template <typename F> struct GenericReplay;
+
+template <typename R, typename... A>
+struct GenericReplay<R (APIENTRY *)(A...)> {
+	typedef R (APIENTRY *Function)(A...);
+
+	static bool takesPointers ()
+	{
+		bool pointers[] = { false, is_pointer<A>::value... };
+		for (size_t i = 0; i < sizeof(pointers) / sizeof(pointers[0]); i++)
+			if (pointers[i])
+				return true;
+		return false;
+	}
+
+	static void run (const ReplayCall& call, const ReplayFunction& function)
+	{
+		ArgReader reader(call.Args);
+		tuple<A...> args { reader.next<A>()... };	// braced lists evaluate left to right
+		invoke((Function) function.Proc, args, typename MakeIndices<sizeof...(A)>::Type());
+	}
+
+	template <int... I>
+	static void invoke (Function f, tuple<A...>& args, Indices<I...>)
+	{
+		f(get<I>(args)...);
+	}
+};
+
+template <typename F>
+ReplayHandler genericHandler ()
+{
+	return GenericReplay<F>::takesPointers() ? NULL : &GenericReplay<F>::run;
+}
+
+/* Queries have no effect on rendering and their results are not needed */
+void replaySkip (const ReplayCall&, const ReplayFunction&) {}
+
+/* The n names recorded with a glGen or glDelete call - false for none, or
+   when the capture holds fewer than n */
+bool recordedNames (const ReplayCall& call, const ReplayFunction& function, GLsizei n)
+{
+	if (n <= 0)
+		return false;
+	if (call.DataBytes < n * sizeof(GLuint)) {
+		fprintf(stderr, "replay: %s records %u bytes for %d names, skipped\n", function.Name.c_str(), call.DataBytes, n);
+		return false;
+	}
+	return true;
+}
+
+void replayGen (const ReplayCall& call, const ReplayFunction& function)
+{
+	GLsizei n = ArgReader(call.Args).next<GLsizei>();
+	if (!recordedNames(call, function, n))
+		return;
+	vector<GLuint> names(n);
+	((PFNGLGENBUFFERSPROC) function.Proc)(n, &names[0]);
+	ArgReader recorded(call.Data);
+	for (int i = 0; i < n; i++)
+		(*function.Names)[recorded.next<GLuint>()] = names[i];
+}
+
+void replayDelete (const ReplayCall& call, const ReplayFunction& function)
+{
+	GLsizei n = ArgReader(call.Args).next<GLsizei>();
+	if (!recordedNames(call, function, n))
+		return;
+	vector<GLuint> names(n);
+	ArgReader recorded(call.Data);
+	for (int i = 0; i < n; i++) {
+		GLuint name = recorded.next<GLuint>();
+		names[i] = mapName(*function.Names, name);
+		function.Names->erase(name);
+	}
+	((PFNGLDELETEBUFFERSPROC) function.Proc)(n, &names[0]);
+}
+
+void replayBindBuffer (const ReplayCall& call, const ReplayFunction&)
+{
+	ArgReader args(call.Args);
+	GLenum target = args.next<GLenum>();
+	glBindBuffer(target, mapName(buffers, args.next<GLuint>()));
+}
+
+void replayBindVertexArray (const ReplayCall& call, const ReplayFunction&)
+{
+	glBindVertexArray(mapName(vertex_arrays, ArgReader(call.Args).next<GLuint>()));
+}
+
+void replayBindTexture (const ReplayCall& call, const ReplayFunction&)
+{
+	ArgReader args(call.Args);
+	GLenum target = args.next<GLenum>();
+	glBindTexture(target, mapName(textures, args.next<GLuint>()));
+}
+
+/* Framebuffers the capture did not create are the game's window */
+void replayBindFramebuffer (const ReplayCall& call, const ReplayFunction&)
+{
+	ArgReader args(call.Args);
+	GLenum target = args.next<GLenum>();
+	GLuint framebuffer = args.next<GLuint>();
+	NameMap::const_iterator it = framebuffers.find(framebuffer);
+	glBindFramebuffer(target, it == framebuffers.end() ? replay_framebuffer : it->second);
+}
+
+void replayBindRenderbuffer (const ReplayCall& call, const ReplayFunction&)
+{
+	ArgReader args(call.Args);
+	GLenum target = args.next<GLenum>();
+	glBindRenderbuffer(target, mapName(renderbuffers, args.next<GLuint>()));
+}
+
+void replayFramebufferRenderbuffer (const ReplayCall& call, const ReplayFunction&)
+{
+	ArgReader args(call.Args);
+	GLenum target = args.next<GLenum>();
+	GLenum attachment = args.next<GLenum>();
+	GLenum renderbuffer_target = args.next<GLenum>();
+	glFramebufferRenderbuffer(target, attachment, renderbuffer_target, mapName(renderbuffers, args.next<GLuint>()));
+}
+
+void replayBeginQuery (const ReplayCall& call, const ReplayFunction&)
+{
+	ArgReader args(call.Args);
+	GLenum target = args.next<GLenum>();
+	glBeginQuery(target, mapName(queries, args.next<GLuint>()));
+}
+
+/* The pointer is an offset into the bound buffer */
+void replayVertexAttribPointer (const ReplayCall& call, const ReplayFunction&)
+{
+	ArgReader args(call.Args);
+	GLuint index = args.next<GLuint>();
+	GLint size = args.next<GLint>();
+	GLenum type = args.next<GLenum>();
+	GLboolean normalized = args.next<GLboolean>();
+	GLsizei stride = args.next<GLsizei>();
+	glVertexAttribPointer(index, size, type, normalized, stride, args.next<const void*>());
+}
+
+void replayVertexAttribIPointer (const ReplayCall& call, const ReplayFunction&)
+{
+	ArgReader args(call.Args);
+	GLuint index = args.next<GLuint>();
+	GLint size = args.next<GLint>();
+	GLenum type = args.next<GLenum>();
+	GLsizei stride = args.next<GLsizei>();
+	glVertexAttribIPointer(index, size, type, stride, args.next<const void*>());
+}
+
+void replayBindBufferRange (const ReplayCall& call, const ReplayFunction&)
+{
+	ArgReader args(call.Args);
+	GLenum target = args.next<GLenum>();
+	GLuint index = args.next<GLuint>();
+	GLuint buffer = mapName(buffers, args.next<GLuint>());
+	GLintptr offset = args.next<GLintptr>();
+	glBindBufferRange(target, index, buffer, offset, args.next<GLsizeiptr>());
+}
+
+void replayTexBuffer (const ReplayCall& call, const ReplayFunction&)
+{
+	ArgReader args(call.Args);
+	GLenum target = args.next<GLenum>();
+	GLenum format = args.next<GLenum>();
+	glTexBuffer(target, format, mapName(buffers, args.next<GLuint>()));
+}
+
+void replayBufferSubData (const ReplayCall& call, const ReplayFunction&)
+{
+	ArgReader args(call.Args);
+	GLenum target = args.next<GLenum>();
+	GLintptr offset = args.next<GLintptr>();
+	glBufferSubData(target, offset, args.next<GLsizeiptr>(), call.Data);
+}
+
+void replayBufferData (const ReplayCall& call, const ReplayFunction&)
+{
+	ArgReader args(call.Args);
+	GLenum target = args.next<GLenum>();
+	GLsizeiptr size = args.next<GLsizeiptr>();
+	args.next<const void*>();
+	GLenum usage = args.next<GLenum>();
+	glBufferData(target, size, call.DataBytes > 0 ? call.Data : NULL, usage);
+}
+
+void replayCreateShader (const ReplayCall& call, const ReplayFunction&)
+{
+	GLuint shader = glCreateShader(ArgReader(call.Args).next<GLenum>());
+	shaders[ArgReader(call.Data).next<GLuint>()] = shader;
+}
+
+void replayCreateProgram (const ReplayCall& call, const ReplayFunction&)
+{
+	programs[ArgReader(call.Data).next<GLuint>()] = glCreateProgram();
+}
+
+void replayShaderSource (const ReplayCall& call, const ReplayFunction&)
+{
+	ArgReader args(call.Args);
+	GLuint shader = mapName(shaders, args.next<GLuint>());
+	GLsizei count = args.next<GLsizei>();
+	vector<const GLchar*> strings(count);
+	vector<GLint> lengths(count);
+	const char* data = call.Data;
+	for (int i = 0; i < count; i++) {
+		lengths[i] = ArgReader(data).next<unsigned int>();
+		strings[i] = data + sizeof(unsigned int);
+		data = strings[i] + lengths[i];
+	}
+	glShaderSource(shader, count, count > 0 ? &strings[0] : NULL, count > 0 ? &lengths[0] : NULL);
+}
+
+void replayCompileShader (const ReplayCall& call, const ReplayFunction&)
+{
+	glCompileShader(mapName(shaders, ArgReader(call.Args).next<GLuint>()));
+}
+
+void replayDeleteShader (const ReplayCall& call, const ReplayFunction&)
+{
+	glDeleteShader(mapName(shaders, ArgReader(call.Args).next<GLuint>()));
+}
+
+void replayAttachShader (const ReplayCall& call, const ReplayFunction&)
+{
+	ArgReader args(call.Args);
+	GLuint program = mapName(programs, args.next<GLuint>());
+	glAttachShader(program, mapName(shaders, args.next<GLuint>()));
+}
+
+void replayLinkProgram (const ReplayCall& call, const ReplayFunction&)
+{
+	glLinkProgram(mapName(programs, ArgReader(call.Args).next<GLuint>()));
+}
+
+void replayDeleteProgram (const ReplayCall& call, const ReplayFunction&)
+{
+	GLuint program = ArgReader(call.Args).next<GLuint>();
+	glDeleteProgram(mapName(programs, program));
+	programs.erase(program);
+}
+
+void replayUseProgram (const ReplayCall& call, const ReplayFunction&)
+{
+	current_program = ArgReader(call.Args).next<GLuint>();
+	glUseProgram(mapName(programs, current_program));
+}
+
+/* Data holds the name followed by the location the game got back */
+void replayGetUniformLocation (const ReplayCall& call, const ReplayFunction&)
+{
+	GLuint program = ArgReader(call.Args).next<GLuint>();
+	GLint recorded = ArgReader(call.Data + call.DataBytes - sizeof(GLint)).next<GLint>();
+	uniform_locations[make_pair(program, recorded)] = glGetUniformLocation(mapName(programs, program), call.Data);
+}
+
+/* Location in this context of a recorded location of the current program */
+GLint mapLocation (GLint location)
+{
+	map<pair<GLuint, GLint>, GLint>::const_iterator it = uniform_locations.find(make_pair(current_program, location));
+	return it == uniform_locations.end() ? location : it->second;
+}
+
+void replayUniformMatrix4fv (const ReplayCall& call, const ReplayFunction&)
+{
+	ArgReader args(call.Args);
+	GLint location = args.next<GLint>();
+	GLsizei count = args.next<GLsizei>();
+	GLboolean transpose = args.next<GLboolean>();
+	glUniformMatrix4fv(mapLocation(location), count, transpose, (const GLfloat*) call.Data);
+}
+
+void replayUniform3fv (const ReplayCall& call, const ReplayFunction&)
+{
+	ArgReader args(call.Args);
+	GLint location = args.next<GLint>();
+	glUniform3fv(mapLocation(location), args.next<GLsizei>(), (const GLfloat*) call.Data);
+}
+
+void replayUniform1i (const ReplayCall& call, const ReplayFunction&)
+{
+	ArgReader args(call.Args);
+	GLint location = args.next<GLint>();
+	glUniform1i(mapLocation(location), args.next<GLint>());
+}
+
+/* Data holds the name followed by the index the game got back */
+void replayGetUniformBlockIndex (const ReplayCall& call, const ReplayFunction&)
+{
+	GLuint program = ArgReader(call.Args).next<GLuint>();
+	GLuint recorded = ArgReader(call.Data + call.DataBytes - sizeof(GLuint)).next<GLuint>();
+	uniform_blocks[make_pair(program, recorded)] = glGetUniformBlockIndex(mapName(programs, program), call.Data);
+}
+
+void replayUniformBlockBinding (const ReplayCall& call, const ReplayFunction&)
+{
+	ArgReader args(call.Args);
+	GLuint program = args.next<GLuint>();
+	GLuint block = args.next<GLuint>();
+	map<pair<GLuint, GLuint>, GLuint>::const_iterator it = uniform_blocks.find(make_pair(program, block));
+	glUniformBlockBinding(mapName(programs, program), it == uniform_blocks.end() ? block : it->second, args.next<GLuint>());
+}
+
+/* Read back into scratch memory so the cost of the readback is kept */
+void replayReadPixels (const ReplayCall& call, const ReplayFunction&)
+{
+	ArgReader args(call.Args);
+	GLint x = args.next<GLint>();
+	GLint y = args.next<GLint>();
+	GLsizei width = args.next<GLsizei>();
+	GLsizei height = args.next<GLsizei>();
+	GLenum format = args.next<GLenum>();
+	GLenum type = args.next<GLenum>();
+	read_pixels.resize(16 * width * height);
+	glReadPixels(x, y, width, height, format, type, &read_pixels[0]);
+}
+
+/* Every function glad loaded, with the handler that replays it */
+map<string, ReplayFunction> replayFunctions ()
+{
+	map<string, ReplayFunction> functions;
+#define GLAD_USE(name) \
+	{ \
+		ReplayFunction function = { #name, genericHandler<decltype(glad_##name)>(), (void*) glad_##name, NULL }; \
+		functions[#name] = function; \
+	}
+#include "glad_used.inc"
+#undef GLAD_USE
+
+	functions["glGenBuffers"].Handler = replayGen;
+	functions["glGenBuffers"].Names = &buffers;
+	functions["glGenVertexArrays"].Handler = replayGen;
+	functions["glGenVertexArrays"].Names = &vertex_arrays;
+	functions["glGenQueries"].Handler = replayGen;
+	functions["glGenQueries"].Names = &queries;
+	functions["glGenFramebuffers"].Handler = replayGen;
+	functions["glGenFramebuffers"].Names = &framebuffers;
+	functions["glGenRenderbuffers"].Handler = replayGen;
+	functions["glGenRenderbuffers"].Names = &renderbuffers;
+	functions["glGenTextures"].Handler = replayGen;
+	functions["glGenTextures"].Names = &textures;
+	functions["glDeleteFramebuffers"].Handler = replayDelete;
+	functions["glDeleteFramebuffers"].Names = &framebuffers;
+	functions["glDeleteRenderbuffers"].Handler = replayDelete;
+	functions["glDeleteRenderbuffers"].Names = &renderbuffers;
+	functions["glDeleteBuffers"].Handler = replayDelete;
+	functions["glDeleteBuffers"].Names = &buffers;
+	functions["glDeleteVertexArrays"].Handler = replayDelete;
+	functions["glDeleteVertexArrays"].Names = &vertex_arrays;
+	functions["glDeleteTextures"].Handler = replayDelete;
+	functions["glDeleteTextures"].Names = &textures;
+	functions["glDeleteQueries"].Handler = replayDelete;
+	functions["glDeleteQueries"].Names = &queries;
+	functions["glDeleteProgram"].Handler = replayDeleteProgram;
+
+	functions["glBindBuffer"].Handler = replayBindBuffer;
+	functions["glBindVertexArray"].Handler = replayBindVertexArray;
+	functions["glBindFramebuffer"].Handler = replayBindFramebuffer;
+	functions["glBindRenderbuffer"].Handler = replayBindRenderbuffer;
+	functions["glBindTexture"].Handler = replayBindTexture;
+	functions["glTexBuffer"].Handler = replayTexBuffer;
+	functions["glFramebufferRenderbuffer"].Handler = replayFramebufferRenderbuffer;
+	functions["glBeginQuery"].Handler = replayBeginQuery;
+	functions["glVertexAttribPointer"].Handler = replayVertexAttribPointer;
+	functions["glVertexAttribIPointer"].Handler = replayVertexAttribIPointer;
+	functions["glBufferData"].Handler = replayBufferData;
+	functions["glBufferSubData"].Handler = replayBufferSubData;
+	functions["glBindBufferRange"].Handler = replayBindBufferRange;
+	functions["glCreateShader"].Handler = replayCreateShader;
+	functions["glCreateProgram"].Handler = replayCreateProgram;
+	functions["glShaderSource"].Handler = replayShaderSource;
+	functions["glCompileShader"].Handler = replayCompileShader;
+	functions["glDeleteShader"].Handler = replayDeleteShader;
+	functions["glAttachShader"].Handler = replayAttachShader;
+	functions["glLinkProgram"].Handler = replayLinkProgram;
+	functions["glUseProgram"].Handler = replayUseProgram;
+	functions["glGetUniformLocation"].Handler = replayGetUniformLocation;
+	functions["glUniformMatrix4fv"].Handler = replayUniformMatrix4fv;
+	functions["glUniform1i"].Handler = replayUniform1i;
+	functions["glUniform3fv"].Handler = replayUniform3fv;
+	functions["glGetUniformBlockIndex"].Handler = replayGetUniformBlockIndex;
+	functions["glUniformBlockBinding"].Handler = replayUniformBlockBinding;
+	functions["glReadPixels"].Handler = replayReadPixels;
+
+	// Queries, and fences: the replay finishes every frame anyway
+	const char* skipped[] = { "glGetError", "glGetString", "glGetShaderiv", "glGetShaderInfoLog", "glGetProgramiv",
+			"glGetProgramInfoLog", "glGetQueryObjectiv", "glGetQueryObjectui64v", "glCheckFramebufferStatus", "glGetIntegerv",
+			"glFenceSync", "glClientWaitSync", "glDeleteSync" };
+	for (size_t i = 0; i < sizeof(skipped) / sizeof(skipped[0]); i++)
+		functions[skipped[i]].Handler = replaySkip;
+	return functions;
+}
+
+struct Capture {
+	vector<char> File;
+	unsigned int Width;
+	unsigned int Height;
+	vector<ReplayFunction> Functions;	// by recorded function id
+	vector<ReplayCall> Calls;
+	vector<size_t> FrameBounds;	// frame i is Calls[FrameBounds[i]] up to Calls[FrameBounds[i + 1]]
+};
+
+/* Load the file and resolve every recorded function against this build */
+bool loadCapture (const char* path, Capture& capture)
+{
+	FILE* in = fopen(path, "rb");
+	if (in == NULL) {
+		fprintf(stderr, "replay: cannot open %s\n", path);
+		return false;
+	}
+	fseek(in, 0, SEEK_END);
+	capture.File.resize(ftell(in));
+	fseek(in, 0, SEEK_SET);
+	size_t read = capture.File.empty() ? 0 : fread(&capture.File[0], 1, capture.File.size(), in);
+	fclose(in);
+
+	unsigned int header[4];
+	if (read != capture.File.size() || read < 4 + sizeof(header) || memcmp(&capture.File[0], "GLCS", 4) != 0) {
+		fprintf(stderr, "replay: %s is not a GL call stream\n", path);
+		return false;
+	}
+	memcpy(header, &capture.File[4], sizeof(header));
+	if (header[0] != GL_CALL_STREAM_VERSION) {
+		fprintf(stderr, "replay: %s has version %u, expected %u\n", path, header[0], GL_CALL_STREAM_VERSION);
+		return false;
+	}
+	capture.Width = header[1];
+	capture.Height = header[2];
+
+	map<string, ReplayFunction> known = replayFunctions();
+	const char* p = &capture.File[4 + sizeof(header)];
+	const char* end = &capture.File[0] + capture.File.size();
+	for (unsigned int i = 0; i < header[3]; i++) {
+		unsigned short length = 0;
+		if ((size_t) (end - p) >= sizeof(length))
+			length = ArgReader(p).next<unsigned short>();
+		if ((size_t) (end - p) < sizeof(length) || (size_t) (end - p) - sizeof(length) < length) {
+			fprintf(stderr, "replay: %s is not a GL call stream\n", path);
+			return false;
+		}
+		string name(p + sizeof(length), length);
+		p += sizeof(length) + length;
+		map<string, ReplayFunction>::const_iterator it = known.find(name);
+		ReplayFunction function = { name, NULL, NULL, NULL };
+		capture.Functions.push_back(it == known.end() ? function : it->second);
+	}
+
+	vector<bool> warned(capture.Functions.size(), false);
+	while ((size_t) (end - p) >= GL_CALL_HEADER_BYTES) {
+		ArgReader header(p);
+		unsigned short id = header.next<unsigned short>();
+		unsigned short arg_bytes = header.next<unsigned short>();
+		header.next<unsigned int>();	// CPU time in the game
+		unsigned int data_bytes = header.next<unsigned int>();
+		if ((size_t) arg_bytes + data_bytes > (size_t) (end - p) - GL_CALL_HEADER_BYTES)
+			break;
+		ReplayCall call = { id, p + GL_CALL_HEADER_BYTES, p + GL_CALL_HEADER_BYTES + arg_bytes, data_bytes };
+		p += GL_CALL_HEADER_BYTES + arg_bytes + data_bytes;
+		if (id == GL_FRAME_MARKER) {
+			capture.FrameBounds.push_back(capture.Calls.size());
+			continue;
+		}
+		if (id >= capture.Functions.size() || capture.Functions[id].Handler == NULL) {
+			// Dropping a call can change what is drawn, so say which
+			if (id < capture.Functions.size() && !warned[id]) {
+				fprintf(stderr, "replay: cannot replay %s, skipped\n", capture.Functions[id].Name.c_str());
+				warned[id] = true;
+			}
+			continue;
+		}
+		capture.Calls.push_back(call);
+	}
+	if (p != end) {
+		// Cut off mid-record, e.g. the game was killed while writing: keep the complete frames
+		fprintf(stderr, "replay: %s is truncated, replaying up to the last complete frame\n", path);
+		capture.Calls.resize(capture.FrameBounds.empty() ? 0 : capture.FrameBounds.back());
+	}
+	if (capture.FrameBounds.size() < 2) {
+		fprintf(stderr, "replay: %s contains no complete frame\n", path);
+		return false;
+	}
+	return true;
+}
+
+void replayCalls (const Capture& capture, size_t begin, size_t end)
+{
+	for (size_t i = begin; i < end; i++) {
+		const ReplayFunction& function = capture.Functions[capture.Calls[i].Function];
+		function.Handler(capture.Calls[i], function);
+	}
+}
+
+double millisecondsSince (chrono::steady_clock::time_point start)
+{
+	return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+int main (int argc, char** argv)
+{
+	const char* path = NULL;
+	int loops = 100;
+	bool headless = false;
+#ifdef ENABLE_HEADLESS
+	const char* dump_path = NULL;
+#endif
+	for (int i = 1; i < argc; i++) {
+		if (string(argv[i]) == "--loops" && i + 1 < argc)
+			loops = atoi(argv[++i]);
+		else if (string(argv[i]) == "--headless")
+			headless = true;
+		else if (string(argv[i]) == "--dump" && i + 1 < argc) {
+#ifdef ENABLE_HEADLESS
+			dump_path = argv[++i];
+#else
+			fprintf(stderr, "replay: --dump needs headless support (make HEADLESS=1)\n");
+			return EXIT_FAILURE;
+#endif
+		}
+		else
+			path = argv[i];
+	}
+	if (path == NULL) {
+		fprintf(stderr, "usage: %s [--headless] [--loops N] [--dump last.ppm] capture.glcs\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+#ifdef ENABLE_HEADLESS
+	// Frames are only read back from the headless framebuffer
+	if (dump_path != NULL && !headless) {
+		fprintf(stderr, "replay: --dump needs --headless\n");
+		return EXIT_FAILURE;
+	}
+#endif
+
+	// Only the size is needed before a context exists, the rest is checked by loadCapture
+	unsigned int size[2] = { 600, 600 };
+	FILE* in = fopen(path, "rb");
+	if (in != NULL) {
+		fseek(in, 8, SEEK_SET);
+		if (fread(size, sizeof(unsigned int), 2, in) != 2)
+			size[0] = size[1] = 600;
+		fclose(in);
+	}
+
+	GLFWwindow* window = NULL;
+#ifdef ENABLE_HEADLESS
+	HeadlessContext headless_context;
+	if (headless) {
+		if (!initHeadless(headless_context, size[0], size[1]))
+			return EXIT_FAILURE;
+		replay_framebuffer = headless_context.Framebuffer;
+	}
+	else
+#endif
+	{
+		if (headless) {
+			fprintf(stderr, "replay: built without headless support (make HEADLESS=1)\n");
+			return EXIT_FAILURE;
+		}
+		if (!glfwInit())
+			return EXIT_FAILURE;
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+		window = glfwCreateWindow(size[0], size[1], "Replay", NULL, NULL);
+		if (window == NULL) {
+			glfwTerminate();
+			return EXIT_FAILURE;
+		}
+		glfwMakeContextCurrent(window);
+		gladLoadGLLoader((GLADloadproc) glfwGetProcAddress);
+		glfwSwapInterval(0);
+	}
+
+	Capture capture;
+	if (!loadCapture(path, capture))
+		return EXIT_FAILURE;
+
+	chrono::steady_clock::time_point setup_start = chrono::steady_clock::now();
+	replayCalls(capture, 0, capture.FrameBounds[0]);
+	glFinish();
+	double setup_ms = millisecondsSince(setup_start);
+
+	int captured_frames = (int) capture.FrameBounds.size() - 1;
+	vector<double> frame_ms;
+	chrono::steady_clock::time_point replay_start = chrono::steady_clock::now();
+	for (int loop = 0; loop < loops; loop++) {
+		for (int frame = 0; frame < captured_frames; frame++) {
+			chrono::steady_clock::time_point frame_start = chrono::steady_clock::now();
+			replayCalls(capture, capture.FrameBounds[frame], capture.FrameBounds[frame + 1]);
+			if (window != NULL)
+				glfwSwapBuffers(window);
+			else
+				glFlush();
+			frame_ms.push_back(millisecondsSince(frame_start));
+		}
+	}
+	glFinish();
+	double replay_ms = millisecondsSince(replay_start);
+
+	printf("{\"replay\": \"%s\", \"renderer\": \"%s\", \"captured_frames\": %d, \"calls\": %d, \"setup_ms\": %.3f, "
+			"\"frames\": %d, \"fps\": %.2f, \"frame_ms\": {\"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f}}\n",
+			path, (const char*) glGetString(GL_RENDERER), captured_frames, (int) capture.Calls.size(), setup_ms,
+			(int) frame_ms.size(), frame_ms.size() / (replay_ms / 1000.0),
+			FrameProfiler::percentile(frame_ms, 50), FrameProfiler::percentile(frame_ms, 95), FrameProfiler::percentile(frame_ms, 99));
+
+#ifdef ENABLE_HEADLESS
+	// The last replayed frame, to compare against the game's own --dump
+	if (headless && dump_path != NULL)
+		dumpHeadlessFrame(headless_context, dump_path);
+	if (headless)
+		destroyHeadless(headless_context);
+#endif
+	glfwTerminate();
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,116 @@
+#ifndef RESOURCES_H
+#define RESOURCES_H
+
+/*
+ * Registry of every GL object and mesh allocation the game creates.
+ *
+ * Creation sites call add() with the object's size and a label, deletion
+ * sites call remove(). The registry keeps counts and bytes by kind (plus the
+ * peak), prints them on demand and lists whatever is still registered at
+ * shutdown as a leak. GL buffer sizes are the bytes passed to glBufferData,
+ * i.e. what the driver has to store, not what it actually allocates.
+ *
+ * Main thread only, like the GL calls it mirrors.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <utility>
+
+class ResourceRegistry {
+public:
+	enum Kind { VERTEX_ARRAY, BUFFER, TEXTURE, SHADER, PROGRAM, FRAMEBUFFER, RENDERBUFFER, QUERY, MESH_HEAP, NUM_KINDS };
+
+	ResourceRegistry ()
+	{
+		for (int i = 0; i < NUM_KINDS; i++) {
+			count[i] = 0;
+			bytes[i] = 0;
+			peak_bytes[i] = 0;
+		}
+	}
+
+	/* GL objects are keyed by name, heap allocations by address */
+	void add (Kind kind, unsigned long long id, size_t size, const char* label)
+	{
+		Entry entry = { size, label };
+		std::pair<Entries::iterator, bool> inserted = entries.insert(std::make_pair(Key(kind, id), entry));
+		if (!inserted.second) {
+			fprintf(stderr, "resources: %s %llu registered twice (%s, %s)\n", names()[kind], id, inserted.first->second.Label, label);
+			return;
+		}
+		count[kind]++;
+		bytes[kind] += size;
+		peak_bytes[kind] = std::max(peak_bytes[kind], bytes[kind]);
+	}
+
+	void remove (Kind kind, unsigned long long id)
+	{
+		Entries::iterator it = entries.find(Key(kind, id));
+		if (it == entries.end()) {
+			fprintf(stderr, "resources: %s %llu released but never registered\n", names()[kind], id);
+			return;
+		}
+		count[kind]--;
+		bytes[kind] -= it->second.Bytes;
+		entries.erase(it);
+	}
+
+	size_t totalBytes (Kind kind) const { return bytes[kind]; }
+	int totalCount (Kind kind) const { return count[kind]; }
+
+	void print () const
+	{
+		printf("--- resources ---\n");
+		printf("%-14s %8s %12s %12s\n", "", "count", "bytes", "peak bytes");
+		size_t gpu = 0;
+		for (int i = 0; i < NUM_KINDS; i++) {
+			printf("%-14s %8d %12zu %12zu\n", names()[i], count[i], bytes[i], peak_bytes[i]);
+			if (i != MESH_HEAP)
+				gpu += bytes[i];
+		}
+		printf("GL data: %.1f KiB, mesh heap: %.1f KiB\n", gpu / 1024.0, bytes[MESH_HEAP] / 1024.0);
+	}
+
+	/* List what is still registered, grouped by kind and label. Returns false on leaks */
+	bool reportLeaks () const
+	{
+		if (entries.empty())
+			return true;
+		std::map<std::pair<int, std::string>, std::pair<int, size_t> > groups;
+		for (Entries::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+			std::pair<int, size_t>& group = groups[std::make_pair(it->first.first, std::string(it->second.Label))];
+			group.first++;
+			group.second += it->second.Bytes;
+		}
+		fprintf(stderr, "--- leaked resources ---\n");
+		for (std::map<std::pair<int, std::string>, std::pair<int, size_t> >::const_iterator it = groups.begin(); it != groups.end(); ++it)
+			fprintf(stderr, "%-14s %-24s %6d objects %10zu bytes\n", names()[it->first.first], it->first.second.c_str(), it->second.first, it->second.second);
+		return false;
+	}
+
+private:
+	typedef std::pair<int, unsigned long long> Key;
+
+	struct Entry {
+		size_t Bytes;
+		const char* Label;	// string literal
+	};
+
+	typedef std::map<Key, Entry> Entries;
+
+	static const char* const* names ()
+	{
+		static const char* const kind_names[NUM_KINDS] = { "vertex array", "buffer", "texture", "shader", "program", "framebuffer", "renderbuffer", "query", "mesh heap" };
+		return kind_names;
+	}
+
+	Entries entries;
+	int count[NUM_KINDS];
+	size_t bytes[NUM_KINDS];
+	size_t peak_bytes[NUM_KINDS];
+};
+
+#endif
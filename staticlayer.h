@@ -0,0 +1,78 @@
+#ifndef STATICLAYER_H
+#define STATICLAYER_H
+
+/*
+ * Cached render of the parts of the scene that only change with the camera
+ * or the level (board and obstacles), for compositing the frame.
+ *
+ * The layer is an FBO with colour and depth renderbuffers of the
+ * framebuffer's size. It is re-rendered only when invalidated; every other
+ * frame blits colour and depth to the window in one call and draws just the
+ * moving objects on top, depth tested against the cached depth, so the
+ * frame's cost no longer grows with the size of the board.
+ *
+ * Blitting depth needs the same depth format on both sides: the headless
+ * FBO has GL_DEPTH_COMPONENT24, a GLFW window 24 bits of depth and 8 of
+ * stencil by default. Include after glad.
+ */
+
+#include <cstdio>
+
+struct StaticLayer {
+	GLuint Framebuffer;	// 0 until created
+	GLuint ColorBuffer;
+	GLuint DepthBuffer;
+	GLenum DepthFormat;	// matches the framebuffer it is blitted to
+	int Width;
+	int Height;
+	bool Valid;	// false: render the static objects again before the next blit
+	unsigned CameraRevision;	// camera matrices the layer was rendered with
+};
+
+/* (Re)allocate the renderbuffers for a framebuffer of 'width' x 'height', creating the FBO the first time */
+inline bool resizeStaticLayer (StaticLayer& layer, int width, int height, GLenum depth_format)
+{
+	if (layer.Framebuffer == 0) {
+		glGenFramebuffers(1, &layer.Framebuffer);
+		glGenRenderbuffers(1, &layer.ColorBuffer);
+		glGenRenderbuffers(1, &layer.DepthBuffer);
+	}
+	layer.DepthFormat = depth_format;
+	layer.Width = width;
+	layer.Height = height;
+	layer.Valid = false;
+
+	glBindRenderbuffer(GL_RENDERBUFFER, layer.ColorBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, layer.DepthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, depth_format, width, height);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, layer.Framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, layer.ColorBuffer);
+	GLenum attachment = depth_format == GL_DEPTH24_STENCIL8 ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, attachment, GL_RENDERBUFFER, layer.DepthBuffer);
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	if (!complete)
+		fprintf(stderr, "static layer: framebuffer incomplete\n");
+	return complete;
+}
+
+/* Copy colour and depth of pixels [x0, x1) x [y0, y1) to the same pixels of the draw framebuffer 'target' */
+inline void blitStaticLayer (const StaticLayer& layer, GLuint target, int x0, int y0, int x1, int y1)
+{
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, layer.Framebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+	glBlitFramebuffer(x0, y0, x1, y1, x0, y0, x1, y1, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+}
+
+inline void destroyStaticLayer (StaticLayer& layer)
+{
+	if (layer.Framebuffer == 0)
+		return;
+	glDeleteFramebuffers(1, &layer.Framebuffer);
+	glDeleteRenderbuffers(1, &layer.ColorBuffer);
+	glDeleteRenderbuffers(1, &layer.DepthBuffer);
+	layer.Framebuffer = 0;
+}
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+ * Scoped timers written out as a Chrome trace (open the JSON in
+ * chrome://tracing or ui.perfetto.dev).
+ *
+ *   TRACE_SCOPE("initGL");          // times the enclosing block
+ *   TRACE_THREAD_NAME("worker");    // labels the calling thread
+ *   TRACE_WRITE("startup_trace.json");
+ *
+ * Everything compiles to nothing unless ENABLE_TRACE is defined (make TRACE=1).
+ * Events are recorded from any thread until TRACE_WRITE is called, after which
+ * recording stops - the trace covers startup only.
+ */
+
+#ifdef ENABLE_TRACE
+
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct TraceEvent {
+	const char* Name;
+	long long Start;	// microseconds since process start
+	long long Duration;
+	int Thread;
+};
+
+struct TraceThreadName {
+	int Thread;
+	std::string Name;
+};
+
+class Tracer {
+public:
+	static Tracer& get ()
+	{
+		static Tracer tracer;
+		return tracer;
+	}
+
+	long long now () const
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - base).count();
+	}
+
+	/* Small stable id for the calling thread, in order of first use */
+	int threadId ()
+	{
+		static thread_local int id = -1;
+		if (id < 0) {
+			std::lock_guard<std::mutex> lock(mutex);
+			id = next_thread++;
+		}
+		return id;
+	}
+
+	void record (const char* name, long long start, long long end)
+	{
+		int thread = threadId();
+		std::lock_guard<std::mutex> lock(mutex);
+		if (written)
+			return;
+		TraceEvent event = { name, start, end - start, thread };
+		events.push_back(event);
+	}
+
+	void nameThread (const char* name)
+	{
+		int thread = threadId();
+		std::lock_guard<std::mutex> lock(mutex);
+		TraceThreadName entry = { thread, name };
+		thread_names.push_back(entry);
+	}
+
+	void write (const char* path)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (written)
+			return;
+		written = true;
+
+		FILE* out = fopen(path, "w");
+		if (out == NULL) {
+			fprintf(stderr, "trace: cannot write %s\n", path);
+			return;
+		}
+		fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+		// Thread names, then the events - no comma after whichever comes last
+		size_t total = thread_names.size() + events.size();
+		for (size_t i = 0; i < thread_names.size(); i++) {
+			fprintf(out, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s\"}}%s\n",
+					thread_names[i].Thread, thread_names[i].Name.c_str(),
+					i + 1 < total ? "," : "");
+		}
+		for (size_t i = 0; i < events.size(); i++) {
+			fprintf(out, "{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %lld, \"dur\": %lld}%s\n",
+					events[i].Name, events[i].Thread, events[i].Start, events[i].Duration,
+					thread_names.size() + i + 1 < total ? "," : "");
+		}
+		fprintf(out, "]}\n");
+		fclose(out);
+		printf("Trace written to %s (%d events)\n", path, (int) events.size());
+	}
+
+private:
+	Tracer () : base(std::chrono::steady_clock::now()), next_thread(0), written(false) {}
+
+	std::chrono::steady_clock::time_point base;
+	std::mutex mutex;
+	std::vector<TraceEvent> events;
+	std::vector<TraceThreadName> thread_names;
+	int next_thread;
+	bool written;
+};
+
+class TraceScope {
+public:
+	explicit TraceScope (const char* name) : name(name), start(Tracer::get().now()) {}
+	~TraceScope () { Tracer::get().record(name, start, Tracer::get().now()); }
+
+private:
+	const char* name;
+	long long start;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define TRACE_THREAD_NAME(name) Tracer::get().nameThread(name)
+#define TRACE_WRITE(path) Tracer::get().write(path)
+
+#else
+
+#define TRACE_SCOPE(name) do {} while (0)
+#define TRACE_THREAD_NAME(name) do {} while (0)
+#define TRACE_WRITE(path) do {} while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+/*
+ * Per-object transforms. Every object in the scene is only translated, so
+ * its MVP is the frame's view-projection with the last column replaced by
+ * VP * (x, y, z, 1) - 12 multiply-adds instead of a 4x4 matrix product.
+ *
+ * modelMVP() picks the path at compile time from the model's type. For many
+ * objects, TranslationBatch keeps the positions as separate x/y/z arrays and
+ * computeTranslatedColumns() produces the last columns with SSE (AVX when
+ * built with -mavx, e.g. make NATIVE=1), so large boards are limited by
+ * memory bandwidth rather than arithmetic.
+ */
+
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtx/transform.hpp>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#endif
+
+/* A model matrix that is a pure translation */
+struct Translation {
+	float X, Y, Z;
+};
+
+/* Any model matrix */
+inline glm::mat4 modelMVP (const glm::mat4& VP, const glm::mat4& model)
+{
+	return VP * model;
+}
+
+/* Translation only: VP with its last column moved */
+inline glm::mat4 modelMVP (const glm::mat4& VP, const Translation& t)
+{
+	glm::mat4 MVP = VP;
+	MVP[3] = VP[0] * t.X + VP[1] * t.Y + VP[2] * t.Z + VP[3];
+	return MVP;
+}
+
+/* VP * translate(x, y, z) */
+inline glm::mat4 translatedMVP (const glm::mat4& VP, float x, float y, float z)
+{
+	Translation t = { x, y, z };
+	return modelMVP(VP, t);
+}
+
+/* Positions of translated objects, one array per coordinate */
+struct TranslationBatch {
+	std::vector<float> X, Y, Z;
+
+	size_t size () const { return X.size(); }
+
+	void add (float x, float y, float z)
+	{
+		X.push_back(x);
+		Y.push_back(y);
+		Z.push_back(z);
+	}
+
+	void set (size_t i, float x, float y, float z)
+	{
+		X[i] = x;
+		Y[i] = y;
+		Z[i] = z;
+	}
+};
+
+/* Last MVP column of each object in a batch, one array per row */
+struct MVPColumns {
+	std::vector<float> X, Y, Z, W;
+
+	/* Full MVP of object i */
+	glm::mat4 mvp (const glm::mat4& VP, size_t i) const
+	{
+		glm::mat4 MVP = VP;
+		MVP[3] = glm::vec4(X[i], Y[i], Z[i], W[i]);
+		return MVP;
+	}
+};
+
+/* rows[r][i] = row r of VP * (x, y, z, 1) for every position, vectorised
+   across objects. The rows can point anywhere, e.g. into a mapped buffer */
+inline void computeTranslatedColumns (const glm::mat4& VP, const TranslationBatch& in, float* const rows[4])
+{
+	size_t n = in.size();
+	if (n == 0)
+		return;
+
+	const float* x = &in.X[0];
+	const float* y = &in.Y[0];
+	const float* z = &in.Z[0];
+	size_t i = 0;
+
+#if defined(__AVX__)
+	for (; i + 8 <= n; i += 8) {
+		__m256 vx = _mm256_loadu_ps(x + i);
+		__m256 vy = _mm256_loadu_ps(y + i);
+		__m256 vz = _mm256_loadu_ps(z + i);
+		for (int r = 0; r < 4; r++) {
+			__m256 v = _mm256_mul_ps(_mm256_set1_ps(VP[0][r]), vx);
+			v = _mm256_add_ps(v, _mm256_mul_ps(_mm256_set1_ps(VP[1][r]), vy));
+			v = _mm256_add_ps(v, _mm256_mul_ps(_mm256_set1_ps(VP[2][r]), vz));
+			v = _mm256_add_ps(v, _mm256_set1_ps(VP[3][r]));
+			_mm256_storeu_ps(rows[r] + i, v);
+		}
+	}
+#elif defined(__SSE__) || defined(_M_X64)
+	for (; i + 4 <= n; i += 4) {
+		__m128 vx = _mm_loadu_ps(x + i);
+		__m128 vy = _mm_loadu_ps(y + i);
+		__m128 vz = _mm_loadu_ps(z + i);
+		for (int r = 0; r < 4; r++) {
+			__m128 v = _mm_mul_ps(_mm_set1_ps(VP[0][r]), vx);
+			v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(VP[1][r]), vy));
+			v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(VP[2][r]), vz));
+			v = _mm_add_ps(v, _mm_set1_ps(VP[3][r]));
+			_mm_storeu_ps(rows[r] + i, v);
+		}
+	}
+#endif
+
+	// Remainder, and everything on other architectures
+	for (; i < n; i++) {
+		for (int r = 0; r < 4; r++)
+			rows[r][i] = VP[0][r] * x[i] + VP[1][r] * y[i] + VP[2][r] * z[i] + VP[3][r];
+	}
+}
+
+/* out = VP * (x, y, z, 1) for every position */
+inline void computeTranslatedColumns (const glm::mat4& VP, const TranslationBatch& in, MVPColumns& out)
+{
+	size_t n = in.size();
+	out.X.resize(n);
+	out.Y.resize(n);
+	out.Z.resize(n);
+	out.W.resize(n);
+	if (n == 0)
+		return;
+
+	float* rows[4] = { &out.X[0], &out.Y[0], &out.Z[0], &out.W[0] };
+	computeTranslatedColumns(VP, in, rows);
+}
+
+#endif